@@ -9,6 +9,7 @@
 #include <map>
 #include <cppitertools/enumerate.hpp>
 #include "bozorth3/bozorth3.h"
+#include "bozorth3/math.h"
 #include "bozorth3/utils.hpp"
 #include "utils.h"
 
@@ -39,7 +40,7 @@ static void limit_edges(std::vector<Edge> &edges) {
 struct Fingerprint {
     std::vector<Minutia> minutiae{};
     std::vector<Edge> edges{};
-//    Edges soa_edges{0};
+    Edges soa_edges{};
 };
 
 static Fingerprint &
@@ -51,11 +52,8 @@ my_cache_data(std::unordered_map<std::string, Fingerprint> &items, const std::st
     auto path = std::filesystem::path{dir2_path};
     path.append(file_name);
     const auto p = path.generic_string();
-    auto p_min = p;
-    p_min.erase(p_min.length() - 3);
-    p_min += "min";
 
-    auto minutia = load_minutiae(p, p_min, max_minutiae);
+    auto minutia = load_minutiae(p, max_minutiae);
     if (!minutia.has_value()) {
         std::cout << path << "\n";
         printf("Cannot load!");
@@ -65,20 +63,68 @@ my_cache_data(std::unordered_map<std::string, Fingerprint> &items, const std::st
     std::vector<Edge> edges{};
     find_edges(minutia.value(), edges, Format::NistInternal);
     limit_edges(edges);
-//    Edges ev{edges.size()};
-//    for (auto &item : edges) {
-//        ev.push(item);
-//    }
-
     auto &item = items[file_name];
     item.minutiae = std::move(minutia.value());
+    item.soa_edges.assign(edges);
     item.edges = std::move(edges);
     return item;
 }
 
+// the expressions replaced by the lookup tables in math.h
+static int reference_atan2_round_degree(int dx, int dy) {
+    if (dx == 0) {
+        return 90;
+    }
+    return rounded(rad_to_deg(atanf(static_cast<float>(dy) / static_cast<float>(dx))));
+}
+
+static int reference_slope_in_degrees(int dx, int dy) {
+    if (dx == 0) {
+        return dy <= 0 ? -90 : 90;
+    }
+    float fi = rad_to_deg(atanf(static_cast<float>(dy) / static_cast<float>(dx)));
+    if (fi < 0.0F) {
+        if (dx < 0) {
+            fi += 180.0F;
+        }
+    } else {
+        if (dx < 0) {
+            fi -= 180.0F;
+        }
+    }
+    int fi2 = rounded(fi);
+    if (fi2 <= -180) {
+        fi2 += 360;
+    }
+    return fi2;
+}
+
+// sweeps every dx, dy the lookup tables may see and reports the ones differing from atanf
+static void check_angles() {
+    constexpr int range = 2000;
+    auto mismatches = 0u;
+    for (int dx = -range; dx <= range; dx++) {
+        for (int dy = -range; dy <= range; dy++) {
+            const int theta = atan2_round_degree(dx, dy);
+            const int expected_theta = reference_atan2_round_degree(dx, dy);
+            const int slope = calculate_slope_in_degrees(dx, dy);
+            const int expected_slope = reference_slope_in_degrees(dx, dy);
+            if (theta != expected_theta || slope != expected_slope) {
+                std::cout << "angle " << dx << " " << dy << " "
+                          << expected_theta << " " << theta << " "
+                          << expected_slope << " " << slope << "\n";
+                mismatches++;
+            }
+        }
+    }
+    std::cout << mismatches << " angle mismatches\n";
+}
+
 using namespace std::chrono;
 
 int main() {
+    check_angles();
+
     std::unordered_map<std::string, Fingerprint> items;
 
     std::filesystem::directory_iterator dir_iter{dir2_path};
@@ -114,8 +160,8 @@ int main() {
             const auto &pfp = my_cache_data(items, paths[i]);
             const auto &gfp = my_cache_data(items, paths[j]);
             const u32 actual_score = match(
-                    pfp.minutiae, pfp.edges,
-                    gfp.minutiae, gfp.edges, Format::NistInternal
+                    pfp.minutiae, pfp.soa_edges.view(),
+                    gfp.minutiae, gfp.soa_edges.view(), Format::NistInternal
             );
             auto expected_score = scores[i * paths.size() + j];
             if (expected_score != actual_score) {
@@ -3,8 +3,13 @@
 #include <cppitertools/itertools.hpp>
 #include <optional>
 #include <vector>
-#include <bitset>
 #include <numeric>
+#include <array>
+#include <bit>
+#include <utility>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include "bozorth3.h"
 
 namespace bz3
@@ -17,11 +22,92 @@ namespace bz3
 		return averager.average();
 	}
 
+	// Edges are ordered by (distance_squared, min_beta, max_beta). The squared distance of an edge
+	// is at most MAX_MINUTIA_DISTANCE^2 < 2^14 and both betas are in (-180, 180], so the three
+	// fields are packed into one 32-bit key (14 + 9 + 9 bits) preserving that order.
+	static inline u32 edge_sort_key(const Edge& edge)
+	{
+		assert(edge.distance_squared >= 0 && edge.distance_squared < (1 << 14));
+		assert(edge.min_beta > -180 && edge.min_beta <= 180);
+		assert(edge.max_beta > -180 && edge.max_beta <= 180);
+
+		return static_cast<u32>(edge.distance_squared) << 18 |
+			static_cast<u32>(edge.min_beta + 179) << 9 |
+			static_cast<u32>(edge.max_beta + 179);
+	}
+
+	// stable LSD radix sort of the edges by their keys, same order as std::stable_sort by the key
+	static void sort_edges_by_key(std::vector<Edge>& edges, std::vector<u32>& keys)
+	{
+		constexpr u32 RADIX_BITS = 11;
+		constexpr u32 RADIX_SIZE = 1u << RADIX_BITS;
+		constexpr u32 RADIX_MASK = RADIX_SIZE - 1;
+		constexpr u32 NUMBER_OF_PASSES = (32 + RADIX_BITS - 1) / RADIX_BITS;
+
+		assert(edges.size() == keys.size());
+		const auto size = static_cast<u32>(edges.size());
+
+		std::array<std::array<u32, RADIX_SIZE>, NUMBER_OF_PASSES> counts{};
+		for (const auto key : keys)
+		{
+			for (u32 pass = 0; pass < NUMBER_OF_PASSES; pass++)
+			{
+				counts[pass][(key >> (pass * RADIX_BITS)) & RADIX_MASK]++;
+			}
+		}
+
+		std::vector<u32> order(size);
+		std::iota(order.begin(), order.end(), 0u);
+		std::vector<u32> sorted_order(size);
+		std::vector<u32> sorted_keys(size);
+
+		for (u32 pass = 0; pass < NUMBER_OF_PASSES; pass++)
+		{
+			const u32 shift = pass * RADIX_BITS;
+			auto& offsets = counts[pass];
+			if (size == 0 || offsets[(keys[0] >> shift) & RADIX_MASK] == size)
+			{
+				continue;
+			}
+
+			u32 total = 0;
+			for (auto& offset : offsets)
+			{
+				total += std::exchange(offset, total);
+			}
+
+			for (u32 i = 0; i < size; i++)
+			{
+				const auto position = offsets[(keys[i] >> shift) & RADIX_MASK]++;
+				sorted_keys[position] = keys[i];
+				sorted_order[position] = order[i];
+			}
+
+			keys.swap(sorted_keys);
+			order.swap(sorted_order);
+		}
+
+		std::vector<Edge> sorted_edges{};
+		sorted_edges.reserve(edges.size());
+		for (const auto index : order)
+		{
+			sorted_edges.push_back(edges[index]);
+		}
+		edges.swap(sorted_edges);
+	}
+
 	void find_edges(
 		std::span<const Minutia> minutiae,
 		std::vector<Edge>& edges, Format format
 	)
 	{
+		std::vector<u32> keys{};
+		keys.reserve(edges.size() + std::min<std::size_t>(minutiae.size() * minutiae.size() / 2, MAX_NUMBER_OF_EDGES));
+		for (const auto& edge : edges)
+		{
+			keys.push_back(edge_sort_key(edge));
+		}
+
 		for (u32 k = 0; k < minutiae.size() - 1; k++)
 		{
 			for (u32 j = k + 1; j < minutiae.size(); j++)
@@ -48,28 +134,25 @@ namespace bz3
 				const int beta_j = normalize_angle(theta_kj - minutiae[j].t + 180);
 
 				Edge edge{};
+				edge.distance_squared = static_cast<u16>(distance_squared);
+				edge.endpoint_k = static_cast<u8>(k);
+				edge.endpoint_j = static_cast<u8>(j);
+				edge.theta_kj = static_cast<i16>(theta_kj);
 				if (beta_k < beta_j)
 				{
-					edge.distance_squared = distance_squared;
-					edge.min_beta = beta_k;
-					edge.max_beta = beta_j;
-					edge.endpoint_k = k;
-					edge.endpoint_j = j;
-					edge.theta_kj = theta_kj;
+					edge.min_beta = static_cast<i16>(beta_k);
+					edge.max_beta = static_cast<i16>(beta_j);
 					edge.beta_order = KJ;
 				}
 				else
 				{
-					edge.distance_squared = distance_squared;
-					edge.min_beta = beta_j;
-					edge.max_beta = beta_k;
-					edge.endpoint_k = k;
-					edge.endpoint_j = j;
-					edge.theta_kj = theta_kj;
+					edge.min_beta = static_cast<i16>(beta_j);
+					edge.max_beta = static_cast<i16>(beta_k);
 					edge.beta_order = JK;
 				}
 
 				edges.push_back(edge);
+				keys.push_back(edge_sort_key(edge));
 				if (edges.size() == MAX_NUMBER_OF_EDGES - 1)
 				{
 					goto sort;
@@ -78,26 +161,7 @@ namespace bz3
 		}
 
 	sort:
-		std::stable_sort(edges.begin(), edges.end(), [](const Edge& left, const Edge& right)
-		{
-			if (left.distance_squared < right.distance_squared)
-			{
-				return true;
-			}
-			if (left.distance_squared > right.distance_squared)
-			{
-				return false;
-			}
-			if (left.min_beta < right.min_beta)
-			{
-				return true;
-			}
-			if (left.min_beta > right.min_beta)
-			{
-				return false;
-			}
-			return left.max_beta < right.max_beta;
-		});
+		sort_edges_by_key(edges, keys);
 	}
 
 	u32 limit_edges_by_length(std::span<Edge> edges)
@@ -129,9 +193,51 @@ namespace bz3
 		return !(difference > ANGLE_LOWER_BOUND && difference < ANGLE_UPPER_BOUND);
 	}
 
+	static inline Pair make_pair_from_edges(
+		const Edge& probe, std::span<const Minutia> probe_minutiae,
+		const Edge& gallery, std::span<const Minutia> gallery_minutiae
+	)
+	{
+		int delta_theta = probe.theta_kj - gallery.theta_kj;
+		if (probe.beta_order != gallery.beta_order)
+		{
+			delta_theta -= 180;
+		}
+
+		Pair pair{};
+		pair.delta_theta = static_cast<i16>(normalize_angle(delta_theta));
+		pair.probe_k = probe.endpoint_k;
+		pair.probe_j = probe.endpoint_j;
+
+		if (probe.beta_order != gallery.beta_order)
+		{
+			pair.gallery_k = gallery.endpoint_j;
+			pair.gallery_j = gallery.endpoint_k;
+		}
+		else
+		{
+			pair.gallery_k = gallery.endpoint_k;
+			pair.gallery_j = gallery.endpoint_j;
+		}
+
+		const auto pkk = probe_minutiae[pair.probe_k].kind;
+		const auto pkj = probe_minutiae[pair.probe_j].kind;
+		const auto gkk = gallery_minutiae[pair.gallery_k].kind;
+		const auto gkj = gallery_minutiae[pair.gallery_j].kind;
+
+		// one point for the pair and one for every matching kind, if all four kinds are known
+		const auto known =
+			static_cast<u32>(pkk != MinutiaKind::Unknown) & static_cast<u32>(pkj != MinutiaKind::Unknown) &
+			static_cast<u32>(gkk != MinutiaKind::Unknown) & static_cast<u32>(gkj != MinutiaKind::Unknown);
+		const auto matching = static_cast<u32>(pkk == gkk) + static_cast<u32>(pkj == gkj);
+		pair.points = static_cast<u8>(1 + known * matching);
+		return pair;
+	}
+
+	template <std::size_t Capacity>
 	void match_edges_into_pairs(std::span<const Edge> probe_edges, std::span<const Minutia> probe_minutiae,
 	                            std::span<const Edge> gallery_edges, std::span<const Minutia> gallery_minutiae,
-	                            PairHolder& pairs)
+	                            PairHolder<Capacity>& pairs)
 	{
 		assert(!probe_edges.empty());
 		assert(!gallery_edges.empty());
@@ -165,58 +271,124 @@ namespace bz3
 					continue;
 				}
 
-				int delta_theta = probe.theta_kj - gallery.theta_kj;
-				if (probe.beta_order != gallery.beta_order)
+				pairs.add(make_pair_from_edges(probe, probe_minutiae, gallery, gallery_minutiae));
+			}
+		}
+	}
+
+#if defined(__AVX2__)
+	static inline __m256i are_angles_equal_with_tolerance(__m256i a, __m256i b)
+	{
+		const __m256i difference = _mm256_abs_epi32(_mm256_sub_epi32(a, b));
+		const __m256i above_lower = _mm256_cmpgt_epi32(difference, _mm256_set1_epi32(ANGLE_LOWER_BOUND));
+		const __m256i below_upper = _mm256_cmpgt_epi32(_mm256_set1_epi32(ANGLE_UPPER_BOUND), difference);
+		return _mm256_andnot_si256(_mm256_and_si256(above_lower, below_upper), _mm256_set1_epi32(-1));
+	}
+#endif
+
+	template <std::size_t Capacity>
+	void match_edges_into_pairs(EdgesView probe_edges, std::span<const Minutia> probe_minutiae,
+	                            EdgesView gallery_edges, std::span<const Minutia> gallery_minutiae,
+	                            PairHolder<Capacity>& pairs)
+	{
+		assert(!probe_edges.empty());
+		assert(!gallery_edges.empty());
+
+#if defined(__AVX2__)
+		static_assert(EdgesView::EDGE_LANES == 8);
+
+		const __m256 factor = _mm256_set1_ps(2.0F * FACTOR);
+		const auto gallery_size = static_cast<u32>(gallery_edges.size());
+
+		u32 start = 0;
+		for (u32 k = 0; k < probe_edges.size() - 1; k++)
+		{
+			const Edge probe = probe_edges[k];
+			const __m256i probe_distance = _mm256_set1_epi32(probe.distance_squared);
+			const __m256i probe_min_beta = _mm256_set1_epi32(probe.min_beta);
+			const __m256i probe_max_beta = _mm256_set1_epi32(probe.max_beta);
+
+			for (u32 j = start; j < gallery_size; j += EdgesView::EDGE_LANES)
+			{
+				const __m256i distance = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+					reinterpret_cast<const __m128i*>(gallery_edges.distance_squared() + j)));
+				const __m256i dz = _mm256_sub_epi32(distance, probe_distance);
+				const __m256 fi = _mm256_mul_ps(factor, _mm256_cvtepi32_ps(_mm256_add_epi32(distance, probe_distance)));
+				const __m256 out_of_tolerance = _mm256_cmp_ps(
+					_mm256_cvtepi32_ps(_mm256_abs_epi32(dz)), fi, _CMP_GT_OQ);
+				const __m256 shorter = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_setzero_si256(), dz));
+
+				// the padding past the last edge is always longer than the tolerance, so this terminates the scan
+				u32 lanes = 0xFF;
+				const auto longer = static_cast<u32>(_mm256_movemask_ps(_mm256_andnot_ps(shorter, out_of_tolerance)));
+				if (longer != 0)
 				{
-					delta_theta -= 180;
+					lanes = (1u << std::countr_zero(longer)) - 1;
 				}
 
-				Pair pair{};
-				pair.delta_theta = normalize_angle(delta_theta);
-				pair.probe_k = probe.endpoint_k;
-				pair.probe_j = probe.endpoint_j;
-
-				if (probe.beta_order != gallery.beta_order)
+				const auto skipped = static_cast<u32>(_mm256_movemask_ps(_mm256_and_ps(shorter, out_of_tolerance))) &
+					lanes;
+				if (skipped != 0)
 				{
-					pair.gallery_k = gallery.endpoint_j;
-					pair.gallery_j = gallery.endpoint_k;
+					start = j + static_cast<u32>(std::bit_width(skipped));
 				}
-				else
+
+				const __m256i angles = _mm256_and_si256(
+					are_angles_equal_with_tolerance(
+						probe_min_beta,
+						_mm256_cvtepi16_epi32(
+							_mm_loadu_si128(reinterpret_cast<const __m128i*>(gallery_edges.min_beta() + j)))),
+					are_angles_equal_with_tolerance(
+						probe_max_beta,
+						_mm256_cvtepi16_epi32(
+							_mm_loadu_si128(reinterpret_cast<const __m128i*>(gallery_edges.max_beta() + j)))));
+				auto matching = static_cast<u32>(_mm256_movemask_ps(
+					_mm256_andnot_ps(out_of_tolerance, _mm256_castsi256_ps(angles)))) & lanes;
+
+				while (matching != 0)
 				{
-					pair.gallery_k = gallery.endpoint_k;
-					pair.gallery_j = gallery.endpoint_j;
+					const auto lane = static_cast<u32>(std::countr_zero(matching));
+					matching &= matching - 1;
+					pairs.add(make_pair_from_edges(probe, probe_minutiae, gallery_edges[j + lane], gallery_minutiae));
 				}
 
-				const auto pkk = probe_minutiae[pair.probe_k].kind;
-				const auto pkj = probe_minutiae[pair.probe_j].kind;
-				const auto gkk = gallery_minutiae[pair.gallery_k].kind;
-				const auto gkj = gallery_minutiae[pair.gallery_j].kind;
+				if (longer != 0)
+				{
+					break;
+				}
+			}
+		}
+#else
+		u32 start = 0;
+		for (u32 k = 0; k < probe_edges.size() - 1; k++)
+		{
+			const Edge probe = probe_edges[k];
 
-				if (pkk.has_value() && pkj.has_value() && gkk.has_value() && gkj.has_value())
+			for (u32 j = start; j < gallery_edges.size(); j++)
+			{
+				const int distance_squared = gallery_edges.distance_squared()[j];
+				const int dz = distance_squared - probe.distance_squared;
+				const float fi = (2.0f * FACTOR) * static_cast<float>(distance_squared + probe.distance_squared);
+				if (static_cast<float>(std::abs(dz)) > fi)
 				{
-					const auto matching = static_cast<u32>(pkk == gkk) + static_cast<u32>(pkj == gkj);
-					switch (matching)
+					if (dz < 0)
 					{
-					case 0:
-						pair.points = 1;
-						break;
-					case 1:
-						pair.points = 2;
-						break;
-					case 2:
-						pair.points = 3;
-						break;
-					default:
-						break;
+						start = j + 1;
+						continue;
 					}
+					break;
 				}
-				else
+
+				if (!(are_angles_equal_with_tolerance(probe.min_beta, gallery_edges.min_beta()[j]) &&
+					are_angles_equal_with_tolerance(probe.max_beta, gallery_edges.max_beta()[j])))
 				{
-					pair.points = 1;
+					continue;
 				}
-				pairs.add(pair);
+
+				pairs.add(make_pair_from_edges(probe, probe_minutiae, gallery_edges[j], gallery_minutiae));
 			}
 		}
+#endif
 	}
 
 	static std::pair<u32, u32> get_current_pair(const EndpointGroup& group)
@@ -238,9 +410,10 @@ namespace bz3
 		return std::make_pair(probe_endpoint, gallery_endpoint);
 	}
 
+	template <std::size_t Capacity>
 	static bool associate_endpoints_of_all_groups(
 		std::span<EndpointGroup> groups,
-		EndpointAssociator<MAX_NUMBER_OF_ENDPOINTS>& associator
+		EndpointAssociator<Capacity>& associator
 	)
 	{
 		for (i32 group_index = static_cast<i32>(groups.size() - 1); group_index >= 0; group_index--)
@@ -269,9 +442,10 @@ namespace bz3
 		return true;
 	}
 
+	template <std::size_t Capacity>
 	static bool try_associate_ambiguous_endpoints(
 		std::span<EndpointGroup> groups,
-		EndpointAssociator<MAX_NUMBER_OF_ENDPOINTS>& associator
+		EndpointAssociator<Capacity>& associator
 	)
 	{
 		for (auto group = groups.rbegin(); group != groups.rend();)
@@ -298,6 +472,23 @@ namespace bz3
 	}
 
 
+	template <Format F>
+	static bool are_slopes_compatible(const ClusterAverages& averages1, const ClusterAverages& averages2)
+	{
+		const int probe_dx = averages2.probe_x - averages1.probe_x;
+		const int probe_dy = averages2.probe_y - averages1.probe_y;
+		const int gallery_dx = averages2.gallery_x - averages1.gallery_x;
+		const int gallery_dy = averages2.gallery_y - averages1.gallery_y;
+
+		const int average = average_angles(averages1.delta_theta, averages2.delta_theta);
+		const int difference = F == Format::Ansi
+			                       ? calculate_slope_in_degrees(probe_dx, -probe_dy) -
+			                       calculate_slope_in_degrees(gallery_dx, -gallery_dy)
+			                       : calculate_slope_in_degrees(probe_dx, probe_dy) -
+			                       calculate_slope_in_degrees(gallery_dx, gallery_dy);
+		return are_angles_equal_with_tolerance(average, normalize_angle(difference));
+	}
+
 	template <Format F>
 	static bool are_clusters_compatible(const ClusterAverages& averages1, const ClusterAverages& averages2)
 	{
@@ -321,46 +512,137 @@ namespace bz3
 			return false;
 		}
 
-		const int average = average_angles(averages1.delta_theta, averages2.delta_theta);
-		const int difference = F == Format::Ansi
-			                       ? calculate_slope_in_degrees(probe_dx, -probe_dy) -
-			                       calculate_slope_in_degrees(gallery_dx, -gallery_dy)
-			                       : calculate_slope_in_degrees(probe_dx, probe_dy) -
-			                       calculate_slope_in_degrees(gallery_dx, gallery_dy);
-		return are_angles_equal_with_tolerance(average, normalize_angle(difference));
+		return are_slopes_compatible<F>(averages1, averages2);
 	}
 
-	inline static bool have_common_endpoints(const ClusterEndpoints& first, const ClusterEndpoints& second)
+	template <std::size_t Capacity>
+	inline static bool have_common_endpoints(const ClusterEndpoints<Capacity>& first,
+	                                         const ClusterEndpoints<Capacity>& second)
 	{
-		return ((first.probe & second.probe) | (first.gallery & second.gallery)).any();
+#if defined(__AVX2__)
+		if constexpr (ClusterEndpoints<Capacity>::WORDS == 4)
+		{
+			const __m256i probe = _mm256_and_si256(
+				_mm256_load_si256(reinterpret_cast<const __m256i*>(first.probe.data())),
+				_mm256_load_si256(reinterpret_cast<const __m256i*>(second.probe.data())));
+			const __m256i gallery = _mm256_and_si256(
+				_mm256_load_si256(reinterpret_cast<const __m256i*>(first.gallery.data())),
+				_mm256_load_si256(reinterpret_cast<const __m256i*>(second.gallery.data())));
+			return !_mm256_testz_si256(_mm256_or_si256(probe, gallery), _mm256_set1_epi32(-1));
+		}
+#endif
+		u64 common = 0;
+		for (auto word = 0u; word < ClusterEndpoints<Capacity>::WORDS; word++)
+		{
+			common |= (first.probe[word] & second.probe[word]) | (first.gallery[word] & second.gallery[word]);
+		}
+		return common != 0;
 	}
 
-	template <Format M>
-	static void merge_compatible_clusters(Clusters& clusters)
+#if defined(__AVX2__)
+	static inline __m256i load_clusters(const i32* values, u32 first, u32 count)
 	{
-		for (auto cluster = 0u; cluster < clusters.size(); ++cluster)
+		if (count >= 8)
+		{
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + first));
+		}
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<i32>(count)), lanes);
+		return _mm256_maskload_epi32(values + first, mask);
+	}
+
+	static inline __m256 distance_squared(__m256i dx, __m256i dy)
+	{
+		return _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy)));
+	}
+
+	/*
+	 * Tests cluster against eight clusters starting at other_cluster for the conditions of
+	 * are_clusters_compatible that do not need slopes: equal average rotation and similar
+	 * distances between the cluster centers on both sides. Returns a mask of lanes passing both.
+	 */
+	static inline u32 are_clusters_close(const ClusterAveragesArrays& averages, u32 cluster, u32 other_cluster,
+	                                     u32 count)
+	{
+		const __m256i delta_theta = load_clusters(averages.delta_theta(), other_cluster, count);
+		const __m256i probe_dx = _mm256_sub_epi32(load_clusters(averages.probe_x(), other_cluster, count),
+		                                          _mm256_set1_epi32(averages.probe_x()[cluster]));
+		const __m256i probe_dy = _mm256_sub_epi32(load_clusters(averages.probe_y(), other_cluster, count),
+		                                          _mm256_set1_epi32(averages.probe_y()[cluster]));
+		const __m256i gallery_dx = _mm256_sub_epi32(load_clusters(averages.gallery_x(), other_cluster, count),
+		                                            _mm256_set1_epi32(averages.gallery_x()[cluster]));
+		const __m256i gallery_dy = _mm256_sub_epi32(load_clusters(averages.gallery_y(), other_cluster, count),
+		                                            _mm256_set1_epi32(averages.gallery_y()[cluster]));
+
+		const __m256i angles = are_angles_equal_with_tolerance(
+			delta_theta, _mm256_set1_epi32(averages.delta_theta()[cluster]));
+
+		const __m256 probe_distance_squared = distance_squared(probe_dx, probe_dy);
+		const __m256 gallery_distance_squared = distance_squared(gallery_dx, gallery_dy);
+		const __m256 a = _mm256_mul_ps(_mm256_set1_ps(2.0F * FACTOR),
+		                               _mm256_add_ps(probe_distance_squared, gallery_distance_squared));
+		const __m256 b = _mm256_andnot_ps(_mm256_set1_ps(-0.0F),
+		                                  _mm256_sub_ps(probe_distance_squared, gallery_distance_squared));
+		const __m256 distances = _mm256_cmp_ps(b, a, _CMP_LE_OQ);
+
+		const auto lanes = count >= 8 ? 0xFFu : (1u << count) - 1;
+		return static_cast<u32>(_mm256_movemask_ps(_mm256_and_ps(_mm256_castsi256_ps(angles), distances))) & lanes;
+	}
+#endif
+
+	template <Format M, std::size_t Capacity>
+	static void merge_compatible_clusters(Clusters<Capacity>& clusters)
+	{
+		const auto size = static_cast<u32>(clusters.size());
+		clusters.compatibility.reset(size);
+
+		for (auto cluster = 0u; cluster < size; ++cluster)
 		{
 			u32 points_from_others = 0;
-			std::vector<u32> compatible_clusters{};
+			const auto averages = clusters.averages[cluster];
+
+#if defined(__AVX2__)
+			for (auto first = cluster + 1; first < size; first += 8)
+			{
+				auto close = are_clusters_close(clusters.averages, cluster, first, size - first);
+				while (close != 0)
+				{
+					const auto other_cluster = first + static_cast<u32>(std::countr_zero(close));
+					close &= close - 1;
+
+					if (have_common_endpoints(clusters.endpoints[cluster], clusters.endpoints[other_cluster]))
+					{
+						continue;
+					}
 
-			for (auto other_cluster = cluster + 1; other_cluster < clusters.size(); ++other_cluster)
+					if (!are_slopes_compatible<M>(averages, clusters.averages[other_cluster]))
+					{
+						continue;
+					}
+
+					points_from_others += clusters.clusters[other_cluster].points;
+					clusters.compatibility.set(cluster, other_cluster);
+				}
+			}
+#else
+			for (auto other_cluster = cluster + 1; other_cluster < size; ++other_cluster)
 			{
 				if (have_common_endpoints(clusters.endpoints[cluster], clusters.endpoints[other_cluster]))
 				{
 					continue;
 				}
 
-				if (!are_clusters_compatible<M>(clusters.averages[cluster], clusters.averages[other_cluster]))
+				if (!are_clusters_compatible<M>(averages, clusters.averages[other_cluster]))
 				{
 					continue;
 				}
 
 				points_from_others += clusters.clusters[other_cluster].points;
-				compatible_clusters.push_back(other_cluster);
+				clusters.compatibility.set(cluster, other_cluster);
 			}
+#endif
 
 			clusters.clusters[cluster].points_from_compatible = clusters.clusters[cluster].points + points_from_others;
-			clusters.clusters[cluster].compatible = std::move(compatible_clusters);
 		}
 	}
 
@@ -397,19 +679,18 @@ namespace bz3
 		return average;
 	}
 
-	static ClusterEndpoints encode_endpoints(
+	template <std::size_t Capacity>
+	static ClusterEndpoints<Capacity> encode_endpoints(
 		std::span<const Pair> pairs,
 		std::span<const u32> selected_pairs
 	)
 	{
-		ClusterEndpoints endpoints{};
+		ClusterEndpoints<Capacity> endpoints{};
 		for (const auto idx : selected_pairs)
 		{
 			const auto& pair = pairs[idx];
-			endpoints.probe.set(pair.probe_k);
-			endpoints.probe.set(pair.probe_j);
-			endpoints.gallery.set(pair.gallery_k);
-			endpoints.gallery.set(pair.gallery_j);
+			endpoints.set(pair.probe_k, pair.gallery_k);
+			endpoints.set(pair.probe_j, pair.gallery_j);
 		}
 		return endpoints;
 	}
@@ -488,6 +769,7 @@ namespace bz3
 		}
 	}
 
+	template <std::size_t Capacity>
 	static void assign_cluster_to_endpoints(
 		const u32 cluster,
 		const u32 pair_index,
@@ -495,7 +777,7 @@ namespace bz3
 		const u32 gallery_endpoint,
 		std::vector<EndpointGroup>& groups,
 		ClusterAssigner<MAX_NUMBER_OF_PAIRS>& assigner,
-		EndpointAssociator<MAX_NUMBER_OF_ENDPOINTS>& associator,
+		EndpointAssociator<Capacity>& associator,
 		std::vector<u32>& endpoints,
 		std::vector<u32>& selected_pairs
 	)
@@ -557,9 +839,10 @@ namespace bz3
 		}
 	}
 
-	static void find_pairs(const PairHolder& pair_holder, const u32 start_pair, const u32 cluster_index,
+	template <std::size_t Capacity>
+	static void find_pairs(const PairHolder<Capacity>& pair_holder, const u32 start_pair, const u32 cluster_index,
 	                       std::vector<EndpointGroup>& groups, std::vector<u32>& selected_pairs,
-	                       EndpointAssociator<MAX_NUMBER_OF_ENDPOINTS>& associator,
+	                       EndpointAssociator<Capacity>& associator,
 	                       ClusterAssigner<MAX_NUMBER_OF_PAIRS>& cluster_assigner)
 	{
 		std::vector<u32> endpoints{};
@@ -621,71 +904,113 @@ namespace bz3
 		}
 	}
 
-	static u32 combine_clusters(std::span<Cluster> clusters)
+	static constexpr u32 NO_CLUSTER = 0xFFFFFFFF;
+
+	static u32 find_next_cluster(std::span<const u64> candidates, u32 position)
 	{
-		struct Item
+		for (auto word = position / 64; word < candidates.size(); word++)
 		{
-			u32 cluster{};
-			u32 index{};
-			std::vector<u32> connected{};
+			auto bits = candidates[word];
+			if (word == position / 64)
+			{
+				bits &= ~u64{0} << (position % 64);
+			}
+			if (bits != 0)
+			{
+				return static_cast<u32>(word * 64 + static_cast<u32>(std::countr_zero(bits)));
+			}
+		}
+		return NO_CLUSTER;
+	}
+
+	static u32 sum_points(std::span<const u64> candidates, std::span<const Cluster> clusters)
+	{
+		u32 points = 0;
+		for (auto word = 0u; word < candidates.size(); word++)
+		{
+			for (auto bits = candidates[word]; bits != 0; bits &= bits - 1)
+			{
+				points += clusters[word * 64 + static_cast<u32>(std::countr_zero(bits))].points;
+			}
+		}
+		return points;
+	}
+
+	/*
+	 * Finds the set of mutually compatible clusters with the most points. Every clique is extended
+	 * by clusters with higher indices only, and a branch is abandoned once its points together with
+	 * all points of its remaining candidates cannot exceed the best score found so far. The search
+	 * ends early once the best score reaches the limit.
+	 */
+	template <std::size_t Capacity>
+	static u32 combine_clusters(const Clusters<Capacity>& clusters, CliqueStack& stack, u32 limit)
+	{
+		const auto& matrix = clusters.compatibility;
+		const auto words = matrix.words_per_row();
+		const auto candidates_at = [&](u32 depth)
+		{
+			return std::span(stack.candidates).subspan(depth * words, words);
 		};
 
-		std::vector<Item> items{};
 		u32 best_score = 0;
 
-		for (const auto [cluster_index, cluster] : iter::enumerate(clusters))
+		// returns whether the level still has candidates which can improve the best score
+		const auto enter = [&](u32 depth) -> bool
 		{
-			if (best_score >= cluster.points_from_compatible)
+			const auto candidates = candidates_at(depth);
+			if (std::all_of(candidates.begin(), candidates.end(), [](u64 bits) { return bits == 0; }))
 			{
-				continue;
+				best_score = std::max(best_score, stack.scores[depth]);
+				return false;
 			}
+			return stack.scores[depth] + sum_points(candidates, clusters.clusters) > best_score;
+		};
 
-			items.emplace_back(Item{
-				.cluster = static_cast<u32>(cluster_index),
-				.index = 0,
-				.connected = cluster.compatible
-			});
+		for (auto root = 0u; root < clusters.size() && best_score < limit; root++)
+		{
+			if (best_score >= clusters.clusters[root].points_from_compatible)
+			{
+				continue;
+			}
 
-			while (!items.empty())
+			stack.reserve(1, words);
+			std::ranges::copy(matrix.row(root), candidates_at(0).begin());
+			stack.scores[0] = clusters.clusters[root].points;
+			stack.positions[0] = root + 1;
+			if (!enter(0))
 			{
-				const auto& last = items.back();
-				if (last.index < last.connected.size())
-				{
-					const auto next_cluster = last.connected.at(last.index);
-					const auto& compatible = clusters[next_cluster].compatible;
-
-					std::vector<u32> connected_clusters{};
-					std::set_intersection(
-						last.connected.cbegin(), last.connected.cend(),
-						compatible.cbegin(), compatible.cend(),
-						std::back_inserter(connected_clusters)
-					);
+				continue;
+			}
 
-					items.push_back(Item{next_cluster, 0, connected_clusters});
-				}
-				else
+			u32 depth = 0;
+			while (best_score < limit)
+			{
+				const auto next = find_next_cluster(candidates_at(depth), stack.positions[depth]);
+				if (next == NO_CLUSTER)
 				{
-					if (last.connected.empty())
+					if (depth == 0)
 					{
-						const u32 score = std::accumulate(
-							items.cbegin(), items.cend(),
-							0u, [&clusters](u32 total, const Item& item)
-							{
-								return total + clusters[item.cluster].points;
-							}
-						);
-
-						if (score > best_score)
-						{
-							best_score = score;
-						}
+						break;
 					}
+					depth--;
+					continue;
+				}
+				stack.positions[depth] = next + 1;
 
-					items.pop_back();
-					if (!items.empty())
-					{
-						items.back().index += 1;
-					}
+				stack.reserve(depth + 2, words);
+				const auto candidates = candidates_at(depth);
+				const auto compatible = matrix.row(next);
+				const auto connected = candidates_at(depth + 1);
+				for (auto word = 0u; word < words; word++)
+				{
+					connected[word] = candidates[word] & compatible[word];
+				}
+				stack.scores[depth + 1] = stack.scores[depth] + clusters.clusters[next].points;
+				stack.positions[depth + 1] = next + 1;
+
+				if (enter(depth + 1))
+				{
+					depth++;
 				}
 			}
 		}
@@ -705,13 +1030,14 @@ namespace bz3
 	}
 
 
-	template <Format F>
-	static u32
+	template <Format F, std::size_t Capacity>
+	static MatchResult
 	match_score(
-		const PairHolder& pair_holder,
-		BozorthState& state,
+		const PairHolder<Capacity>& pair_holder,
+		BozorthState<Capacity>& state,
 		std::span<const Minutia> probe_minutia,
-		std::span<const Minutia> gallery_minutia
+		std::span<const Minutia> gallery_minutia,
+		std::optional<u32> threshold
 	)
 	{
 		assert(!pair_holder.empty());
@@ -756,11 +1082,16 @@ namespace bz3
 						Cluster{
 							.points = points,
 							.points_from_compatible = points,
-							.compatible = {}
 						},
 						calculate_averages(probe_minutia, gallery_minutia, pair_holder.pairs(), state.selected_pairs),
-						encode_endpoints(pair_holder.pairs(), state.selected_pairs)
+						encode_endpoints<Capacity>(pair_holder.pairs(), state.selected_pairs)
 					);
+
+					// every cluster alone is a candidate for the final score
+					if (threshold.has_value() && points >= threshold.value())
+					{
+						return MatchResult{.score = points, .kind = ScoreKind::LowerBound};
+					}
 				}
 
 				if (state.clusters.size() > MAX_NUMBER_OF_CLUSTERS - 1)
@@ -790,6 +1121,21 @@ namespace bz3
 			state.associator.clear_by_probe(probe_k);
 		}
 
+		if (threshold.has_value())
+		{
+			// the final score never exceeds the points of all clusters together
+			u32 total_points = 0;
+			for (const auto& cluster : state.clusters.clusters)
+			{
+				total_points += cluster.points;
+			}
+
+			if (total_points < threshold.value())
+			{
+				return MatchResult{.score = total_points, .kind = ScoreKind::UpperBound};
+			}
+		}
+
 		merge_compatible_clusters<F>(state.clusters);
 
 		u32 match_score = 0;
@@ -800,28 +1146,90 @@ namespace bz3
 
 		if (match_score < SCORE_THRESHOLD)
 		{
-			return match_score;
+			return MatchResult{.score = match_score};
+		}
+
+		if (!threshold.has_value())
+		{
+			return MatchResult{.score = combine_clusters(state.clusters, state.clique_stack, UINT32_MAX)};
 		}
-		return combine_clusters(state.clusters.clusters);
+
+		// every combination of clusters is compatible with its first cluster
+		if (match_score < threshold.value())
+		{
+			return MatchResult{.score = match_score, .kind = ScoreKind::UpperBound};
+		}
+
+		const auto score = combine_clusters(state.clusters, state.clique_stack, threshold.value());
+		return MatchResult{
+			.score = score,
+			.kind = score >= threshold.value() ? ScoreKind::LowerBound : ScoreKind::Exact,
+		};
 	}
 
 
+	template <std::size_t Capacity>
+	u32 score_upper_bound(const PairHolder<Capacity>& holder)
+	{
+		// a cluster needs at least this many pairs
+		if (holder.pairs().size() < MIN_NUMBER_OF_PAIRS_TO_CLUSTER)
+		{
+			return 0;
+		}
+		// combined clusters share no pairs, lower scores may count a pair more than once
+		return std::max(holder.total_points(), static_cast<u32>(SCORE_THRESHOLD - 1));
+	}
+
+	template <std::size_t Capacity>
 	u32 match_score(
-		const PairHolder& holder,
-		BozorthState& state,
+		const PairHolder<Capacity>& holder,
+		BozorthState<Capacity>& state,
 		std::span<const Minutia> probe_minutiae,
 		std::span<const Minutia> gallery_minutiae,
 		Format format
 	)
+	{
+		return match_score(holder, state, probe_minutiae, gallery_minutiae, format, std::nullopt).score;
+	}
+
+	template <std::size_t Capacity>
+	MatchResult match_score(
+		const PairHolder<Capacity>& holder,
+		BozorthState<Capacity>& state,
+		std::span<const Minutia> probe_minutiae,
+		std::span<const Minutia> gallery_minutiae,
+		Format format,
+		std::optional<u32> threshold
+	)
 	{
 		if (holder.empty())
 		{
-			return 0;
+			return MatchResult{};
 		}
 		state.clear();
 
 		return format == Format::Ansi
-			       ? match_score<Format::Ansi>(holder, state, probe_minutiae, gallery_minutiae)
-			       : match_score<Format::NistInternal>(holder, state, probe_minutiae, gallery_minutiae);
+			       ? match_score<Format::Ansi>(holder, state, probe_minutiae, gallery_minutiae, threshold)
+			       : match_score<Format::NistInternal>(holder, state, probe_minutiae, gallery_minutiae, threshold);
 	}
+
+#define INSTANTIATE_MATCHER(CAPACITY) \
+	template void match_edges_into_pairs(std::span<const Edge>, std::span<const Minutia>, \
+	                                     std::span<const Edge>, std::span<const Minutia>, \
+	                                     PairHolder<CAPACITY>&); \
+	template void match_edges_into_pairs(EdgesView, std::span<const Minutia>, \
+	                                     EdgesView, std::span<const Minutia>, \
+	                                     PairHolder<CAPACITY>&); \
+	template u32 score_upper_bound(const PairHolder<CAPACITY>&); \
+	template u32 match_score(const PairHolder<CAPACITY>&, BozorthState<CAPACITY>&, \
+	                         std::span<const Minutia>, std::span<const Minutia>, Format); \
+	template MatchResult match_score(const PairHolder<CAPACITY>&, BozorthState<CAPACITY>&, \
+	                                 std::span<const Minutia>, std::span<const Minutia>, Format, \
+	                                 std::optional<u32>);
+
+	INSTANTIATE_MATCHER(SMALL_MINUTIAE_CAPACITY)
+	INSTANTIATE_MATCHER(MEDIUM_MINUTIAE_CAPACITY)
+	INSTANTIATE_MATCHER(MAX_BOZORTH_MINUTIAE)
+
+#undef INSTANTIATE_MATCHER
 }
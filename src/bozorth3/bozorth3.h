@@ -5,9 +5,11 @@
 #pragma once
 
 #include <span>
-#include <bitset>
+#include <array>
+#include <optional>
 #include <vector>
 #include "constants.h"
+#include "edges.h"
 #include "pair_holder.h"
 
 namespace bz3
@@ -24,9 +26,19 @@ namespace bz3
 
 	void find_edges(std::span<const Minutia> minutiae, std::vector<Edge>& edges, Format format);
 
+	template <std::size_t Capacity>
 	void match_edges_into_pairs(std::span<const Edge> probe_edges, std::span<const Minutia> probe_minutiae,
 	                            std::span<const Edge> gallery_edges, std::span<const Minutia> gallery_minutiae,
-	                            PairHolder& pairs);
+	                            PairHolder<Capacity>& pairs);
+
+	/*
+	 * Same as above for edges stored as structures of arrays; scans the gallery edges with the AVX2 kernel
+	 * (or a scalar loop when AVX2 is not available). Produces exactly the same pairs in the same order.
+	 */
+	template <std::size_t Capacity>
+	void match_edges_into_pairs(EdgesView probe_edges, std::span<const Minutia> probe_minutiae,
+	                            EdgesView gallery_edges, std::span<const Minutia> gallery_minutiae,
+	                            PairHolder<Capacity>& pairs);
 
 	struct ClusterAverages
 	{
@@ -41,26 +53,116 @@ namespace bz3
 	{
 		u32 points = 0;
 		u32 points_from_compatible = 0;
-		std::vector<u32> compatible;
 	};
 
+	// bit j of row i is set when clusters i < j are compatible; rows are padded to whole words
+	class CompatibilityMatrix
+	{
+	private:
+		std::vector<u64> bits_{};
+		std::size_t words_per_row_ = 0;
+
+	public:
+		void reset(std::size_t size)
+		{
+			words_per_row_ = (size + 63) / 64;
+			bits_.assign(size * words_per_row_, 0);
+		}
+
+		void set(std::size_t row, std::size_t column)
+		{
+			bits_[row * words_per_row_ + column / 64] |= u64{1} << (column % 64);
+		}
+
+		[[nodiscard]] std::size_t words_per_row() const { return words_per_row_; }
+
+		[[nodiscard]] std::span<const u64> row(std::size_t row) const
+		{
+			return std::span(bits_).subspan(row * words_per_row_, words_per_row_);
+		}
+	};
+
+	// endpoints of the pairs of a cluster as bit sets packed into whole words
+	template <std::size_t Capacity>
 	struct ClusterEndpoints
 	{
-		std::bitset<MAX_BOZORTH_MINUTIAE> probe{};
-		std::bitset<MAX_BOZORTH_MINUTIAE> gallery{};
+		static constexpr std::size_t WORDS = (Capacity + 63) / 64;
+
+		alignas(32) std::array<u64, WORDS> probe{};
+		alignas(32) std::array<u64, WORDS> gallery{};
+
+		void set(u32 probe_endpoint, u32 gallery_endpoint)
+		{
+			probe[probe_endpoint / 64] |= u64{1} << (probe_endpoint % 64);
+			gallery[gallery_endpoint / 64] |= u64{1} << (gallery_endpoint % 64);
+		}
 	};
 
+	// averages of all clusters as a structure of arrays, so that one cluster can be tested against many
+	class ClusterAveragesArrays
+	{
+	private:
+		std::vector<i32> delta_theta_{};
+		std::vector<i32> probe_x_{};
+		std::vector<i32> probe_y_{};
+		std::vector<i32> gallery_x_{};
+		std::vector<i32> gallery_y_{};
+
+	public:
+		void clear()
+		{
+			delta_theta_.clear();
+			probe_x_.clear();
+			probe_y_.clear();
+			gallery_x_.clear();
+			gallery_y_.clear();
+		}
+
+		void push_back(const ClusterAverages& averages)
+		{
+			delta_theta_.push_back(averages.delta_theta);
+			probe_x_.push_back(averages.probe_x);
+			probe_y_.push_back(averages.probe_y);
+			gallery_x_.push_back(averages.gallery_x);
+			gallery_y_.push_back(averages.gallery_y);
+		}
+
+		[[nodiscard]] ClusterAverages operator[](std::size_t index) const
+		{
+			return ClusterAverages{
+				.delta_theta = delta_theta_[index],
+				.probe_x = probe_x_[index],
+				.probe_y = probe_y_[index],
+				.gallery_x = gallery_x_[index],
+				.gallery_y = gallery_y_[index],
+			};
+		}
+
+		[[nodiscard]] const i32* delta_theta() const { return delta_theta_.data(); }
+
+		[[nodiscard]] const i32* probe_x() const { return probe_x_.data(); }
+
+		[[nodiscard]] const i32* probe_y() const { return probe_y_.data(); }
+
+		[[nodiscard]] const i32* gallery_x() const { return gallery_x_.data(); }
+
+		[[nodiscard]] const i32* gallery_y() const { return gallery_y_.data(); }
+	};
+
+	template <std::size_t Capacity>
 	struct Clusters
 	{
 		std::vector<Cluster> clusters{};
-		std::vector<ClusterAverages> averages{};
-		std::vector<ClusterEndpoints> endpoints{};
+		ClusterAveragesArrays averages{};
+		std::vector<ClusterEndpoints<Capacity>> endpoints{};
+		CompatibilityMatrix compatibility{};
 
 		void clear()
 		{
 			clusters.clear();
 			averages.clear();
 			endpoints.clear();
+			compatibility.reset(0);
 		}
 
 		[[nodiscard]] std::size_t size() const
@@ -68,7 +170,7 @@ namespace bz3
 			return clusters.size();
 		}
 
-		void push_back(Cluster&& cluster, ClusterAverages&& average, ClusterEndpoints&& endpoint)
+		void push_back(Cluster&& cluster, ClusterAverages&& average, ClusterEndpoints<Capacity>&& endpoint)
 		{
 			clusters.push_back(cluster);
 			averages.push_back(average);
@@ -91,13 +193,37 @@ namespace bz3
 		std::optional<u32> to_clear{};
 	};
 
+	// stack of the clique search in combine_clusters, kept between comparisons to avoid allocations
+	struct CliqueStack
+	{
+		std::vector<u64> candidates{};
+		std::vector<u32> scores{};
+		std::vector<u32> positions{};
+
+		void reserve(std::size_t depth, std::size_t words_per_row)
+		{
+			if (scores.size() < depth)
+			{
+				scores.resize(depth);
+				positions.resize(depth);
+			}
+			if (candidates.size() < depth * words_per_row)
+			{
+				candidates.resize(depth * words_per_row);
+			}
+		}
+	};
+
+	// scratch state of match_score for templates of at most Capacity minutiae
+	template <std::size_t Capacity = MAX_BOZORTH_MINUTIAE>
 	struct BozorthState
 	{
-		Clusters clusters{};
-		EndpointAssociator<MAX_NUMBER_OF_ENDPOINTS> associator{};
+		Clusters<Capacity> clusters{};
+		EndpointAssociator<Capacity> associator{};
 		ClusterAssigner<MAX_NUMBER_OF_PAIRS> cluster_assigner{};
 		std::vector<EndpointGroup> groups{};
 		std::vector<u32> selected_pairs{};
+		CliqueStack clique_stack{};
 
 		void clear()
 		{
@@ -109,6 +235,50 @@ namespace bz3
 		}
 	};
 
-	u32 match_score(const PairHolder& holder, BozorthState& state, std::span<const Minutia> probe_minutiae,
-	                std::span<const Minutia> gallery_minutiae, Format format);
+	template <std::size_t Capacity>
+	u32 match_score(const PairHolder<Capacity>& holder, BozorthState<Capacity>& state,
+	                std::span<const Minutia> probe_minutiae, std::span<const Minutia> gallery_minutiae, Format format);
+
+	/*
+	 * Upper bound on the score of the pairs, which needs neither PairHolder::prepare nor clustering.
+	 * Later clusters can take over pairs of earlier ones, so clusters may share pairs. Clusters combined
+	 * into a score are compatible with each other though, and compatible clusters have no common endpoints,
+	 * so they share no pair and the score stays within the points of all pairs. Only scores below
+	 * SCORE_THRESHOLD come from points_from_compatible instead, which adds up the clusters compatible with
+	 * one cluster even when they share pairs among themselves. The bound is therefore never below
+	 * SCORE_THRESHOLD - 1 and rejects nothing for lower thresholds.
+	 */
+	template <std::size_t Capacity>
+	u32 score_upper_bound(const PairHolder<Capacity>& holder);
+
+	enum class ScoreKind
+	{
+		// the score is the one match_score would return
+		Exact,
+		// the score would be at least this high, which already reaches the threshold
+		LowerBound,
+		// the score would be at most this high, which is still below the threshold
+		UpperBound
+	};
+
+	struct MatchResult
+	{
+		u32 score = 0;
+		ScoreKind kind = ScoreKind::Exact;
+
+		[[nodiscard]] bool reaches(u32 threshold) const
+		{
+			return score >= threshold;
+		}
+	};
+
+	/*
+	 * Same as above, but when a threshold is given, stops as soon as the score is known to reach it
+	 * or to stay below it, and returns the bound found at that point. Without a threshold the result
+	 * is always exact.
+	 */
+	template <std::size_t Capacity>
+	MatchResult match_score(const PairHolder<Capacity>& holder, BozorthState<Capacity>& state,
+	                        std::span<const Minutia> probe_minutiae, std::span<const Minutia> gallery_minutiae,
+	                        Format format, std::optional<u32> threshold);
 }
@@ -22,6 +22,8 @@
 #define SCORE_THRESHOLD                 8
 #define MAX_NUMBER_OF_GROUPS            10
 #define MAX_BOZORTH_MINUTIAE            200
+#define SMALL_MINUTIAE_CAPACITY         64
+#define MEDIUM_MINUTIAE_CAPACITY        128
 #define MIN_BOZORTH_MINUTIAE            0
 #define MAX_NUMBER_OF_PAIRS             20000
 #define MAX_NUMBER_OF_EDGES             20000
@@ -29,45 +31,57 @@
 #define MAX_NUMBER_OF_ENDPOINTS         20000
 
 
-enum class MinutiaKind
+enum class MinutiaKind : u8
 {
+	Unknown = 0,
 	Bif = 1,
 	Rig = 2
 };
 
+// coordinates and direction fit in 16 bits, so a minutia takes 8 bytes
 struct Minutia
 {
-	i32 x{};
-	i32 y{};
-	i32 t{};
-	std::optional<MinutiaKind> kind{};
+	i16 x{};
+	i16 y{};
+	i16 t{};
+	MinutiaKind kind = MinutiaKind::Unknown;
 };
 
+static_assert(sizeof(Minutia) == 8);
+
+// endpoints fit in a byte and points are 1-3, so a pair takes 8 bytes
 struct Pair
 {
-	i32 delta_theta;
-	u32 probe_k;
-	u32 probe_j;
-	u32 gallery_k;
-	u32 gallery_j;
-	u32 points;
+	i16 delta_theta;
+	u8 probe_k;
+	u8 probe_j;
+	u8 gallery_k;
+	u8 gallery_j;
+	u8 points;
 };
 
-enum OrderKJ
+static_assert(sizeof(Pair) == 8);
+
+enum OrderKJ : u8
 {
 	KJ,
 	JK
 };
 
+// squared distances are at most MAX_MINUTIA_DISTANCE^2, angles are in (-180, 180] and endpoints are
+// below MAX_BOZORTH_MINUTIAE, so an edge takes 12 bytes
 struct Edge
 {
-	i32 distance_squared;
-	i32 min_beta;
-	i32 max_beta;
-	u32 endpoint_k;
-	u32 endpoint_j;
-	i32 theta_kj;
+	u16 distance_squared;
+	i16 min_beta;
+	i16 max_beta;
+	u8 endpoint_k;
+	u8 endpoint_j;
+	i16 theta_kj;
 	enum OrderKJ beta_order;
 };
 
+static_assert(sizeof(Edge) == 12);
+static_assert(MAX_MINUTIA_DISTANCE * MAX_MINUTIA_DISTANCE <= UINT16_MAX && MAX_BOZORTH_MINUTIAE <= UINT8_MAX + 1);
+
 #endif
@@ -0,0 +1,230 @@
+#ifndef BZ_EDGES_H
+#define BZ_EDGES_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <vector>
+#include "constants.h"
+
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+
+	template <typename U>
+	explicit AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+	{
+	}
+
+	T* allocate(std::size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+	}
+
+	void deallocate(T* pointer, std::size_t) noexcept
+	{
+		::operator delete(pointer, std::align_val_t{Alignment});
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+};
+
+/*
+ * Edges stored as a structure of arrays, so that the pair generation kernel can compare
+ * one probe edge against EDGE_LANES gallery edges at once. Every array is followed by
+ * EDGE_LANES padding entries with a distance that is out of tolerance for any real edge,
+ * which lets the kernel load full vectors past the last edge without a separate tail loop.
+ *
+ * The view does not own the arrays; they belong to an Edges or to a mapped template pack.
+ */
+class EdgesView
+{
+public:
+	static constexpr std::size_t EDGE_LANES = 8;
+	static constexpr u16 PADDING_DISTANCE = UINT16_MAX;
+
+private:
+	const u16* distance_squared_ = nullptr;
+	const i16* min_beta_ = nullptr;
+	const i16* max_beta_ = nullptr;
+	const i16* theta_kj_ = nullptr;
+	const u8* endpoint_k_ = nullptr;
+	const u8* endpoint_j_ = nullptr;
+	const OrderKJ* beta_order_ = nullptr;
+	std::size_t size_ = 0;
+
+public:
+	EdgesView() = default;
+
+	EdgesView(std::size_t size, const u16* distance_squared, const i16* min_beta, const i16* max_beta,
+	          const i16* theta_kj, const u8* endpoint_k, const u8* endpoint_j, const OrderKJ* beta_order)
+		: distance_squared_{distance_squared}, min_beta_{min_beta}, max_beta_{max_beta}, theta_kj_{theta_kj},
+		  endpoint_k_{endpoint_k}, endpoint_j_{endpoint_j}, beta_order_{beta_order}, size_{size}
+	{
+	}
+
+	[[nodiscard]] std::size_t size() const { return size_; }
+
+	[[nodiscard]] bool empty() const { return size_ == 0; }
+
+	[[nodiscard]] Edge operator[](std::size_t index) const
+	{
+		return Edge{
+			.distance_squared = distance_squared_[index],
+			.min_beta = min_beta_[index],
+			.max_beta = max_beta_[index],
+			.endpoint_k = endpoint_k_[index],
+			.endpoint_j = endpoint_j_[index],
+			.theta_kj = theta_kj_[index],
+			.beta_order = beta_order_[index],
+		};
+	}
+
+	[[nodiscard]] const u16* distance_squared() const { return distance_squared_; }
+
+	[[nodiscard]] const i16* min_beta() const { return min_beta_; }
+
+	[[nodiscard]] const i16* max_beta() const { return max_beta_; }
+
+	[[nodiscard]] const i16* theta_kj() const { return theta_kj_; }
+
+	[[nodiscard]] const u8* endpoint_k() const { return endpoint_k_; }
+
+	[[nodiscard]] const u8* endpoint_j() const { return endpoint_j_; }
+
+	[[nodiscard]] const OrderKJ* beta_order() const { return beta_order_; }
+};
+
+// owning structure of arrays of edges, see EdgesView
+class Edges
+{
+public:
+	static constexpr std::size_t EDGE_LANES = EdgesView::EDGE_LANES;
+	static constexpr u16 PADDING_DISTANCE = EdgesView::PADDING_DISTANCE;
+
+private:
+	template <typename T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T, 32>>;
+
+	AlignedVector<u16> distance_squared_{};
+	AlignedVector<i16> min_beta_{};
+	AlignedVector<i16> max_beta_{};
+	AlignedVector<i16> theta_kj_{};
+	AlignedVector<u8> endpoint_k_{};
+	AlignedVector<u8> endpoint_j_{};
+	AlignedVector<OrderKJ> beta_order_{};
+	std::size_t size_ = 0;
+
+	void pad()
+	{
+		const auto padded = size_ + EDGE_LANES;
+		distance_squared_.resize(padded, PADDING_DISTANCE);
+		min_beta_.resize(padded, 0);
+		max_beta_.resize(padded, 0);
+		theta_kj_.resize(padded, 0);
+		endpoint_k_.resize(padded, 0);
+		endpoint_j_.resize(padded, 0);
+		beta_order_.resize(padded, KJ);
+		std::fill(distance_squared_.begin() + static_cast<std::ptrdiff_t>(size_), distance_squared_.end(),
+		          PADDING_DISTANCE);
+	}
+
+public:
+	Edges()
+	{
+		pad();
+	}
+
+	explicit Edges(std::size_t capacity)
+	{
+		reserve(capacity);
+		pad();
+	}
+
+	explicit Edges(std::span<const Edge> edges)
+	{
+		assign(edges);
+	}
+
+	void reserve(std::size_t capacity)
+	{
+		const auto padded = capacity + EDGE_LANES;
+		distance_squared_.reserve(padded);
+		min_beta_.reserve(padded);
+		max_beta_.reserve(padded);
+		theta_kj_.reserve(padded);
+		endpoint_k_.reserve(padded);
+		endpoint_j_.reserve(padded);
+		beta_order_.reserve(padded);
+	}
+
+	void assign(std::span<const Edge> edges)
+	{
+		size_ = edges.size();
+		pad();
+		for (std::size_t i = 0; i < size_; i++)
+		{
+			distance_squared_[i] = edges[i].distance_squared;
+			min_beta_[i] = edges[i].min_beta;
+			max_beta_[i] = edges[i].max_beta;
+			theta_kj_[i] = edges[i].theta_kj;
+			endpoint_k_[i] = edges[i].endpoint_k;
+			endpoint_j_[i] = edges[i].endpoint_j;
+			beta_order_[i] = edges[i].beta_order;
+		}
+	}
+
+	void push(const Edge& edge)
+	{
+		distance_squared_[size_] = edge.distance_squared;
+		min_beta_[size_] = edge.min_beta;
+		max_beta_[size_] = edge.max_beta;
+		theta_kj_[size_] = edge.theta_kj;
+		endpoint_k_[size_] = edge.endpoint_k;
+		endpoint_j_[size_] = edge.endpoint_j;
+		beta_order_[size_] = edge.beta_order;
+		size_++;
+		pad();
+	}
+
+	void clear()
+	{
+		size_ = 0;
+		pad();
+	}
+
+	[[nodiscard]] std::size_t size() const { return size_; }
+
+	[[nodiscard]] bool empty() const { return size_ == 0; }
+
+	[[nodiscard]] Edge operator[](std::size_t index) const { return view()[index]; }
+
+	[[nodiscard]] EdgesView view() const
+	{
+		return EdgesView{
+			size_, distance_squared_.data(), min_beta_.data(), max_beta_.data(), theta_kj_.data(),
+			endpoint_k_.data(), endpoint_j_.data(), beta_order_.data()
+		};
+	}
+
+	// bytes of memory taken by the arrays
+	[[nodiscard]] std::size_t capacity_bytes() const
+	{
+		return distance_squared_.capacity() * sizeof(u16) + min_beta_.capacity() * sizeof(i16) +
+			max_beta_.capacity() * sizeof(i16) + theta_kj_.capacity() * sizeof(i16) + endpoint_k_.capacity() +
+			endpoint_j_.capacity() + beta_order_.capacity() * sizeof(OrderKJ);
+	}
+};
+
+#endif //BZ_EDGES_H
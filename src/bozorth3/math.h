@@ -5,11 +5,16 @@
 #ifndef BZ_MATH_H
 #define BZ_MATH_H
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include "constants.h"
 
 #define M_PI 3.14159265358979323846
 
-inline int rounded(float x)
+constexpr int rounded(float x)
 {
 	if (x < 0.0F)
 	{
@@ -22,20 +27,11 @@ inline int rounded(float x)
 	return static_cast<int>(x);
 }
 
-inline float rad_to_deg(float rad)
+constexpr float rad_to_deg(float rad)
 {
 	return (180.0F / static_cast<float>(M_PI)) * rad;
 }
 
-inline int atan2_round_degree(int dx, int dy)
-{
-	if (dx == 0)
-	{
-		return 90;
-	}
-	return rounded(rad_to_deg(atanf(static_cast<float>(dy) / static_cast<float>(dx))));
-}
-
 inline bool check(int a, int b)
 {
 	if (b > 0)
@@ -73,33 +69,144 @@ inline int squared(int x)
 	return x * x;
 }
 
-inline int calculate_slope_in_degrees(int dx, int dy)
+/*
+ * Angles of edges and cluster slopes used to be computed as rounded(rad_to_deg(atanf(dy / dx))).
+ * That expression is monotone in |dy / dx|, so for every rounded degree there is a smallest float
+ * ratio which reaches it. These ratios are found once at startup by bisecting the bit patterns of
+ * floats with the very same expression, so the results match the platform atanf bit for bit, and
+ * the degree is then looked up by counting the thresholds below the ratio, without calling libm.
+ */
+namespace trig
 {
-	if (dx != 0)
+	constexpr int NUMBER_OF_THRESHOLDS = 90;
+	constexpr int TABLE_SIZE = MAX_MINUTIA_DISTANCE + 1;
+
+	using Thresholds = std::array<float, NUMBER_OF_THRESHOLDS>;
+
+	// rad_to_deg(atanf(ratio)), the expression the thresholds are taken from
+	inline float degrees(float ratio)
 	{
-		float fi = rad_to_deg(atanf(static_cast<float>(dy) / static_cast<float>(dx)));
-		if (fi < 0.0F)
+		return rad_to_deg(std::atan(ratio));
+	}
+
+	// rounded degree of the slope in the first quadrant
+	inline bool is_rounded_above(float ratio, int degree)
+	{
+		return rounded(degrees(ratio)) > degree;
+	}
+
+	// rounded supplement of the slope in the second quadrant, as computed by calculate_slope_in_degrees
+	inline bool is_supplement_rounded_below(float ratio, int degree)
+	{
+		return rounded(180.0F - degrees(ratio)) < 180 - degree;
+	}
+
+	// smallest ratio for which the predicate holds; it lies close to the tangent of the exact boundary,
+	// so the bit patterns of floats within 1% of that tangent are bisected
+	template <typename Predicate>
+	float find_threshold(int degree, Predicate predicate)
+	{
+		const double tangent = std::tan((static_cast<double>(degree) + 0.5) * M_PI / 180.0);
+		auto below = std::bit_cast<std::uint32_t>(static_cast<float>(tangent * 0.99));
+		auto above = std::bit_cast<std::uint32_t>(static_cast<float>(tangent * 1.01));
+		while (above - below > 1)
 		{
-			if (dx < 0)
+			const auto middle = below + (above - below) / 2;
+			if (predicate(std::bit_cast<float>(middle), degree))
+			{
+				above = middle;
+			}
+			else
 			{
-				fi += 180.0f;
+				below = middle;
 			}
 		}
-		else
+		return std::bit_cast<float>(above);
+	}
+
+	// number of thresholds not greater than the ratio; thresholds up to 44.5 degrees are below 1
+	inline int count_thresholds(const Thresholds& thresholds, float ratio)
+	{
+		constexpr auto OCTANT = NUMBER_OF_THRESHOLDS / 2;
+		const auto begin = ratio <= 1.0F ? thresholds.begin() : thresholds.begin() + OCTANT;
+		const auto end = ratio <= 1.0F ? thresholds.begin() + OCTANT : thresholds.end();
+		return static_cast<int>(std::upper_bound(begin, end, ratio) - thresholds.begin());
+	}
+
+	struct Tables
+	{
+		// rounded[d] is the smallest ratio for which the rounded slope exceeds d degrees
+		Thresholds rounded{};
+		// supplement[d] is the smallest ratio for which the rounded supplement drops below 180 - d
+		Thresholds supplement{};
+		// degrees[dx][dy] is the rounded slope in degrees for 0 < dx <= MAX_MINUTIA_DISTANCE
+		// and 0 <= dy <= MAX_MINUTIA_DISTANCE (the row for dx == 0 is unused)
+		std::array<std::array<std::uint8_t, TABLE_SIZE>, TABLE_SIZE> degrees{};
+	};
+
+	inline Tables make_tables()
+	{
+		Tables tables{};
+		for (int degree = 0; degree < NUMBER_OF_THRESHOLDS; degree++)
+		{
+			const auto index = static_cast<std::size_t>(degree);
+			tables.rounded[index] = find_threshold(degree, is_rounded_above);
+			tables.supplement[index] = find_threshold(degree, is_supplement_rounded_below);
+		}
+		for (int dx = 1; dx < TABLE_SIZE; dx++)
 		{
-			if (dx < 0)
+			for (int dy = 0; dy < TABLE_SIZE; dy++)
 			{
-				fi -= 180.0F;
+				const float ratio = static_cast<float>(dy) / static_cast<float>(dx);
+				tables.degrees[static_cast<std::size_t>(dx)][static_cast<std::size_t>(dy)] =
+					static_cast<std::uint8_t>(count_thresholds(tables.rounded, ratio));
 			}
 		}
-		int fi2 = rounded(fi);
-		if (fi2 <= -180)
+		return tables;
+	}
+
+	inline const Tables TABLES = make_tables();
+
+	inline int rounded_degrees(int dx, int dy)
+	{
+		if (dx <= MAX_MINUTIA_DISTANCE && dy <= MAX_MINUTIA_DISTANCE)
 		{
-			fi2 += 360;
+			return TABLES.degrees[static_cast<std::size_t>(dx)][static_cast<std::size_t>(dy)];
 		}
-		return fi2;
+		return count_thresholds(TABLES.rounded, static_cast<float>(dy) / static_cast<float>(dx));
+	}
+}
+
+inline int atan2_round_degree(int dx, int dy)
+{
+	if (dx == 0)
+	{
+		return 90;
+	}
+	const int degree = trig::rounded_degrees(std::abs(dx), std::abs(dy));
+	return (dx < 0) != (dy < 0) ? -degree : degree;
+}
+
+inline int calculate_slope_in_degrees(int dx, int dy)
+{
+	if (dx == 0)
+	{
+		return dy <= 0 ? -90 : 90;
+	}
+
+	if (dx > 0)
+	{
+		const int degree = trig::rounded_degrees(dx, std::abs(dy));
+		return dy < 0 ? -degree : degree;
+	}
+
+	const float ratio = static_cast<float>(std::abs(dy)) / static_cast<float>(-dx);
+	const int supplement = 180 - trig::count_thresholds(trig::TABLES.supplement, ratio);
+	if (dy > 0 || supplement == 180)
+	{
+		return supplement;
 	}
-	return dy <= 0 ? -90 : 90;
+	return -supplement;
 }
 
 #endif //BZ_MATH_H
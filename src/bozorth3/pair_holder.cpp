@@ -3,10 +3,36 @@
 //
 
 #include <iostream>
+#include <numeric>
 #include "pair_holder.h"
 
+// stable counting sort by an endpoint, which is always less than Capacity
+template <std::size_t Capacity, typename T, typename Endpoint>
+static void counting_sort(std::span<const T> input, std::span<T> output, Endpoint endpoint)
+{
+	assert(input.size() == output.size());
+
+	std::array<u32, Capacity + 1> offsets{};
+	for (const auto& item : input)
+	{
+		assert(endpoint(item) < Capacity);
+		offsets[endpoint(item) + 1]++;
+	}
+
+	for (auto i = 1u; i < offsets.size(); i++)
+	{
+		offsets[i] += offsets[i - 1];
+	}
+
+	for (const auto& item : input)
+	{
+		output[offsets[endpoint(item)]++] = item;
+	}
+}
+
 
-void PairHolder::prepare()
+template <std::size_t Capacity>
+void PairHolder<Capacity>::prepare()
 {
 	assert(!forward_.empty());
 	assert(backward_.empty());
@@ -16,26 +42,15 @@ void PairHolder::prepare()
 		return;
 	}
 
-	std::stable_sort(forward_.begin(), forward_.end(), [](const Pair& left, const Pair& right)
-	{
-		if (left.probe_k < right.probe_k)
-		{
-			return true;
-		}
-		if (left.probe_k > right.probe_k)
-		{
-			return false;
-		}
-		if (left.gallery_k < right.gallery_k)
-		{
-			return true;
-		}
-		if (left.gallery_k > right.gallery_k)
-		{
-			return false;
-		}
-		return left.probe_j < right.probe_j;
-	});
+	// (probe_k, gallery_k, probe_j) order by stable counting passes from the least significant endpoint
+	sorted_.resize(forward_.size());
+	counting_sort<Capacity>(std::span<const Pair>(forward_), std::span(sorted_),
+	                        [](const Pair& pair) { return pair.probe_j; });
+	counting_sort<Capacity>(std::span<const Pair>(sorted_), std::span(forward_),
+	                        [](const Pair& pair) { return pair.gallery_k; });
+	counting_sort<Capacity>(std::span<const Pair>(forward_), std::span(sorted_),
+	                        [](const Pair& pair) { return pair.probe_k; });
+	forward_.swap(sorted_);
 
 	{
 		std::optional<std::tuple<u32, u32>> previous = std::nullopt;
@@ -49,7 +64,7 @@ void PairHolder::prepare()
 				if (previous != current)
 				{
 					const auto [ppk, pgk] = previous.value();
-					forward_cache_[ppk * MAX_BOZORTH_MINUTIAE + pgk] = OptionalRange<u32>{range_start, i};
+					forward_cache_[ppk * Capacity + pgk] = OptionalRange<u32>{range_start, i};
 					previous = current;
 					range_start = i;
 				}
@@ -62,40 +77,23 @@ void PairHolder::prepare()
 		if (previous.has_value())
 		{
 			const auto [probe_k, gallery_k] = previous.value();
-			forward_cache_[probe_k * MAX_BOZORTH_MINUTIAE + gallery_k] = OptionalRange<u32>{
+			forward_cache_[probe_k * Capacity + gallery_k] = OptionalRange<u32>{
 				range_start, static_cast<u32>(forward_.size())
 			};
 		}
 	}
 
-	backward_.reserve(forward_.size());
-	for (auto i = 0u; i < forward_.size(); i++)
+	// (probe_j, gallery_j, index) order; the indices start in increasing order and the passes are stable
+	backward_.resize(forward_.size());
+	std::iota(backward_.begin(), backward_.end(), 0u);
+	backward_sorted_.resize(forward_.size());
+	counting_sort<Capacity>(std::span<const u32>(backward_), std::span(backward_sorted_), [&](const u32 index)
 	{
-		backward_.push_back(i);
-	}
-
-	std::sort(backward_.begin(), backward_.end(), [&](const u32 left, const u32 right) -> bool
+		return forward_[index].gallery_j;
+	});
+	counting_sort<Capacity>(std::span<const u32>(backward_sorted_), std::span(backward_), [&](const u32 index)
 	{
-		const auto& l = forward_[left];
-		const auto& r = forward_[right];
-
-		if (l.probe_j < r.probe_j)
-		{
-			return true;
-		}
-		if (l.probe_j > r.probe_j)
-		{
-			return false;
-		}
-		if (l.gallery_j < r.gallery_j)
-		{
-			return true;
-		}
-		if (l.gallery_j > r.gallery_j)
-		{
-			return false;
-		}
-		return left < right;
+		return forward_[index].probe_j;
 	});
 
 	{
@@ -111,7 +109,7 @@ void PairHolder::prepare()
 				if (previous != current)
 				{
 					const auto [ppj, pgj] = previous.value();
-					backward_cache_[MAX_BOZORTH_MINUTIAE * ppj + pgj] = OptionalRange<u32>{range_start, i};
+					backward_cache_[Capacity * ppj + pgj] = OptionalRange<u32>{range_start, i};
 					previous = current;
 					range_start = i;
 				}
@@ -124,7 +122,7 @@ void PairHolder::prepare()
 		if (previous.has_value())
 		{
 			const auto [pj, gj] = previous.value();
-			backward_cache_[pj * MAX_BOZORTH_MINUTIAE + gj] = OptionalRange<u32>{
+			backward_cache_[pj * Capacity + gj] = OptionalRange<u32>{
 				range_start, static_cast<u32>(backward_.size())
 			};
 		}
@@ -133,19 +131,40 @@ void PairHolder::prepare()
 	dirty_ = false;
 }
 
-void PairHolder::clear()
+template <std::size_t Capacity>
+PairHolder<Capacity>::PairHolder()
 {
-	backward_.clear();
-	forward_.clear();
-
 	std::fill(forward_cache_.begin(), forward_cache_.end(), OptionalRange<u32>::empty());
 	std::fill(backward_cache_.begin(), backward_cache_.end(), OptionalRange<u32>::empty());
+}
+
+template <std::size_t Capacity>
+void PairHolder<Capacity>::clear()
+{
+	// prepare() sets only the ranges of endpoints of the current pairs, so only those are reset
+	for (const auto& pair : forward_)
+	{
+		forward_cache_[pair.probe_k * Capacity + pair.gallery_k] = OptionalRange<u32>::empty();
+		backward_cache_[pair.probe_j * Capacity + pair.gallery_j] = OptionalRange<u32>::empty();
+	}
+
+	backward_.clear();
+	forward_.clear();
+	total_points_ = 0;
 
 	dirty_ = true;
 }
 
-void PairHolder::add(Pair pair)
+template <std::size_t Capacity>
+void PairHolder<Capacity>::add(Pair pair)
 {
+	assert(pair.probe_k < Capacity && pair.probe_j < Capacity);
+	assert(pair.gallery_k < Capacity && pair.gallery_j < Capacity);
 	forward_.emplace_back(pair);
+	total_points_ += pair.points;
 	dirty_ = true;
 }
+
+template class PairHolder<SMALL_MINUTIAE_CAPACITY>;
+template class PairHolder<MEDIUM_MINUTIAE_CAPACITY>;
+template class PairHolder<MAX_BOZORTH_MINUTIAE>;
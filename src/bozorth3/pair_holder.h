@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <array>
 #include <cppitertools/enumerate.hpp>
+#include <functional>
 #include <iterator>
 #include <vector>
 
@@ -33,20 +34,35 @@ struct OptionalRange
 	}
 };
 
+/*
+ * Pairs of matching edges indexed by their endpoints. Capacity bounds the number of minutiae of
+ * both templates, so that the endpoint indexes of smaller templates take less memory.
+ */
+template <std::size_t Capacity = MAX_BOZORTH_MINUTIAE>
 class PairHolder
 {
 private:
 	std::vector<Pair> forward_{};
 	std::vector<u32> backward_{};
-	std::array<OptionalRange<u32>, MAX_BOZORTH_MINUTIAE * MAX_BOZORTH_MINUTIAE> forward_cache_{};
-	std::array<OptionalRange<u32>, MAX_BOZORTH_MINUTIAE * MAX_BOZORTH_MINUTIAE> backward_cache_{};
+	std::vector<Pair> sorted_{};
+	std::vector<u32> backward_sorted_{};
+	std::array<OptionalRange<u32>, Capacity * Capacity> forward_cache_{};
+	std::array<OptionalRange<u32>, Capacity * Capacity> backward_cache_{};
+	u32 total_points_ = 0;
 	bool dirty_ = false;
 
 public:
+	static constexpr std::size_t CAPACITY = Capacity;
+
+	PairHolder();
+
 	void add(Pair pair);
 
 	[[nodiscard]] bool empty() const { return forward_.empty(); }
 
+	// sum of points of all added pairs, available before prepare()
+	[[nodiscard]] u32 total_points() const { return total_points_; }
+
 	void clear();
 
 	void prepare();
@@ -56,16 +72,18 @@ public:
 		return std::span(forward_);
 	}
 
+	// calls visitor(pair_index, probe_k, gallery_k) for every pair at or after offset ending at the given endpoints
+	template <typename Visitor>
 	void find_pairs_by_second_endpoint(
 		std::size_t offset,
 		u32 probe_endpoint,
 		u32 gallery_endpoint,
-		const std::function<void(std::size_t, u32, u32)>& callback
+		Visitor&& visitor
 	) const
 	{
 		assert(!dirty_);
 
-		if (const auto range = backward_cache_[probe_endpoint * MAX_BOZORTH_MINUTIAE + gallery_endpoint]; range.
+		if (const auto range = backward_cache_[probe_endpoint * Capacity + gallery_endpoint]; range.
 			has_value()
 		)
 		{
@@ -76,48 +94,61 @@ public:
 			{
 				if (*item >= offset)
 				{
-					callback(*item, forward_[*item].probe_k, forward_[*item].gallery_k);
+					visitor(static_cast<std::size_t>(*item), forward_[*item].probe_k, forward_[*item].gallery_k);
 				}
 			}
 		}
 	}
 
-	size_t find_pairs_by_first_endpoint(
+	void find_pairs_by_second_endpoint(
 		std::size_t offset,
 		u32 probe_endpoint,
 		u32 gallery_endpoint,
 		const std::function<void(std::size_t, u32, u32)>& callback
 	) const
 	{
-		assert(!dirty_);
+		find_pairs_by_second_endpoint<>(offset, probe_endpoint, gallery_endpoint, callback);
+	}
 
-		Pair pair{};
-		pair.probe_k = probe_endpoint;
-		pair.gallery_k = gallery_endpoint;
+	// calls visitor(pair_index, probe_j, gallery_j) for every pair at or after offset starting at the given endpoints,
+	// returns the index past the last such pair (or offset if there are none)
+	template <typename Visitor>
+	size_t find_pairs_by_first_endpoint(
+		std::size_t offset,
+		u32 probe_endpoint,
+		u32 gallery_endpoint,
+		Visitor&& visitor
+	) const
+	{
+		assert(!dirty_);
 
-		if (const auto range = forward_cache_[probe_endpoint * MAX_BOZORTH_MINUTIAE + gallery_endpoint]; range.
+		if (const auto range = forward_cache_[probe_endpoint * Capacity + gallery_endpoint]; range.
 			has_value()
 		)
 		{
-			const auto begin = forward_.cbegin() + static_cast<i32>(range.begin);
-			const auto end = forward_.cbegin() + static_cast<i32>(range.end);
-
-			for (auto item = begin; item != end; item++)
+			const auto first = std::max(static_cast<std::size_t>(range.begin), offset);
+			for (auto index = first; index < range.end; index++)
 			{
-				const auto index = static_cast<size_t>(std::distance(forward_.cbegin(), item));
-				if (index >= offset)
-				{
-					callback(index, item->probe_j, item->gallery_j);
-				}
+				visitor(index, forward_[index].probe_j, forward_[index].gallery_j);
 			}
 
-			return static_cast<std::size_t>(std::distance(forward_.cbegin(), end));
+			return static_cast<std::size_t>(range.end);
 		}
 		else
 		{
 			return offset;
 		}
 	}
+
+	size_t find_pairs_by_first_endpoint(
+		std::size_t offset,
+		u32 probe_endpoint,
+		u32 gallery_endpoint,
+		const std::function<void(std::size_t, u32, u32)>& callback
+	) const
+	{
+		return find_pairs_by_first_endpoint<>(offset, probe_endpoint, gallery_endpoint, callback);
+	}
 };
 
 
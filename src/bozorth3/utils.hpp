@@ -2,6 +2,7 @@
 // Created by Dariusz Niedoba on 06.10.2018.
 //
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <array>
@@ -18,12 +19,15 @@ class EndpointAssociator
 private:
 	std::array<u32, N> probe_by_gallery_{0};
 	std::array<u32, N> gallery_by_probe_{0};
+	// entries at or above this endpoint were not written since the last clear()
+	u32 used_endpoints_ = 0;
 
 public:
 	void associate_endpoints(u32 probe_endpoint, u32 gallery_endpoint)
 	{
 		probe_by_gallery_[gallery_endpoint] = probe_endpoint + 1;
 		gallery_by_probe_[probe_endpoint] = gallery_endpoint + 1;
+		used_endpoints_ = std::max(used_endpoints_, std::max(probe_endpoint, gallery_endpoint) + 1);
 	}
 
 	void clear_by_probe(u32 probe_endpoint)
@@ -69,15 +73,9 @@ public:
 
 	void clear()
 	{
-		for (auto& value : probe_by_gallery_)
-		{
-			value = 0;
-		}
-
-		for (auto& value : gallery_by_probe_)
-		{
-			value = 0;
-		}
+		std::fill_n(probe_by_gallery_.begin(), used_endpoints_, 0u);
+		std::fill_n(gallery_by_probe_.begin(), used_endpoints_, 0u);
+		used_endpoints_ = 0;
 	}
 };
 
@@ -141,6 +139,8 @@ class ClusterAssigner
 {
 private:
 	std::array<i32, N> cluster_by_pair_{0};
+	// entries at or above this pair index were not written since the last clear()
+	u32 used_pairs_ = 0;
 
 public:
 	[[nodiscard]] std::optional<u32> get_cluster(u32 pair_index) const
@@ -161,19 +161,19 @@ public:
 	void assign_cluster(u32 pair_index, u32 cluster)
 	{
 		cluster_by_pair_[pair_index] = cluster + 1;
+		used_pairs_ = std::max(used_pairs_, pair_index + 1);
 	}
 
 	void restore(u32 pair_index)
 	{
 		cluster_by_pair_[pair_index] = MARKER_UNASSIGNED;
+		used_pairs_ = std::max(used_pairs_, pair_index + 1);
 	}
 
 	void clear()
 	{
-		for (auto& value : cluster_by_pair_)
-		{
-			value = 0;
-		}
+		std::fill_n(cluster_by_pair_.begin(), used_pairs_, 0);
+		used_pairs_ = 0;
 	}
 };
 
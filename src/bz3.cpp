@@ -7,11 +7,18 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <charconv>
 #include <cppitertools/itertools.hpp>
 #include <cxxopts.hpp>
 #include "bozorth3/bozorth3.h"
 #include "bozorth3/utils.hpp"
 #include "utils.h"
+#include "minutiae_record.h"
+#include "template_file.h"
+#include "template_pack.h"
+#include "template_cache.h"
+#include "score_matrix.h"
+#include "result_writer.h"
 #include "ThreadPool.h"
 
 #define MIN_BOZORTH_MINUTIAE 0
@@ -44,15 +51,26 @@ enum class MatchMode
 	AllMatches
 };
 
+enum class OutputFormat
+{
+	Text,
+	Matrix
+};
+
 struct Options
 {
 	bool use_ansi = false;
 	MatchMode mode = MatchMode::All;
 	int threshold = 40;
+	bool early_exit = false;
 	bool dry_run = false;
+	bool stream = false;
+	bool report_progress = false;
 	int max_minutiae = 150;
+	int cache_mb = 0;
 	u32 threads = 1;
 
+	std::string template_cache{};
 	std::string pair_file{};
 	std::string probe_files{};
 	std::string gallery_files{};
@@ -62,8 +80,11 @@ struct Options
 
 	std::optional<Range> probe_range = std::nullopt;
 	std::optional<Range> gallery_range = std::nullopt;
+	// packs listed among the inputs, handed to the matcher by run()
+	std::vector<std::shared_ptr<const TemplatePack>> template_packs{};
 
 	bool only_scores = false;
+	OutputFormat output_format = OutputFormat::Text;
 	std::optional<std::string> output_file{};
 	//    std::string output_directory{};
 };
@@ -142,7 +163,15 @@ std::vector<std::string> get_items_from_directory(const std::string& directory)
 		}
 
 		const auto path = entry.path().string();
-		if (!ends_with(path, ".xyt"))
+		if (is_minutiae_record(path))
+		{
+			for (auto&& view : list_finger_views(path))
+			{
+				files.push_back(std::move(view));
+			}
+			continue;
+		}
+		if (!ends_with(path, ".xyt") && !is_template_file(path))
 		{
 			continue;
 		}
@@ -173,6 +202,27 @@ std::vector<std::string> get_items_from_file_or_directory(const std::string& pat
 	return {};
 }
 
+// templates of a pack are matched straight from its mapping, so only their names are listed
+std::vector<std::string> get_items_from_pack(const std::string& path, Options& options)
+{
+	std::shared_ptr<const TemplatePack> pack = TemplatePack::open(
+		path, static_cast<u32>(options.max_minutiae),
+		options.use_ansi ? bz3::Format::Ansi : bz3::Format::NistInternal);
+	if (pack == nullptr)
+	{
+		return {};
+	}
+
+	std::vector<std::string> items{};
+	items.reserve(pack->size());
+	for (std::size_t i = 0; i < pack->size(); i++)
+	{
+		items.emplace_back(pack->name(i));
+	}
+	options.template_packs.push_back(std::move(pack));
+	return items;
+}
+
 using Score = int;
 
 enum class CompareMode
@@ -185,28 +235,30 @@ enum class CompareMode
 using CallbackResult = bool;
 using ScoreCallback = std::function<static_cast<CallbackResult>(std::optional<Score>)>;
 using MatchCallback = std::function<void(const std::string &, const std::string &, std::optional<Score>)>;
-using CacheItem = std::pair<std::vector<Minutia>, std::vector<Edge>>;
 
+static std::optional<Score> match_templates(const TemplateRef& probe, const TemplateRef& gallery,
+                                            bz3::Format format, std::optional<u32> threshold)
+{
+	return std::make_optional<Score>(match(probe.minutiae, probe.edges, gallery.minutiae, gallery.edges,
+	                                       format, threshold).score);
+}
+
+// templates are resolved by the worker running the task, not by the thread scheduling it
 static auto make_generic_executor(
-	const std::string& probe,
-	const std::string& gallery,
-	std::map<std::string, CacheItem>& cache,
+	u32 probe,
+	u32 gallery,
+	TemplateCache& cache,
 	bz3::Format format,
-	u32 max_minutiae
+	std::optional<u32> threshold
 )
 {
-	const auto gallery_cache = cache_data(cache, gallery, max_minutiae);
-	const auto probe_cache = cache_data(cache, probe, max_minutiae);
-
-	return [format, gc = gallery_cache, pc = probe_cache]() -> std::optional<Score>
+	return [&cache, probe, gallery, format, threshold]() -> std::optional<Score>
 	{
-		if (gc.has_value() && pc.has_value())
+		const auto gallery_template = cache.get(gallery);
+		const auto probe_template = cache.get(probe);
+		if (gallery_template.has_value() && probe_template.has_value())
 		{
-			const auto [gallery_minutia, gallery_edges] = gc.value();
-			const auto [probe_minutia, probe_edges] = pc.value();
-			const auto score = match(probe_minutia, probe_edges, gallery_minutia, gallery_edges,
-			                         bz3::Format::NistInternal);
-			return std::make_optional(score);
+			return match_templates(probe_template.value(), gallery_template.value(), format, threshold);
 		}
 		return std::nullopt;
 	};
@@ -223,24 +275,66 @@ struct ExecuteParallelOptions
 	u32 max_minutiae{};
 	bz3::Format format = bz3::Format::NistInternal;
 	u32 threads{};
+	// when set, scores are only computed far enough to tell whether they reach it
+	std::optional<u32> threshold{};
+	bool report_progress = false;
+	std::size_t cache_budget = TemplateCache::UNLIMITED;
 	u32 chunk_size = 1000;
 };
 
-static void execute_parallel_one_to_one(const ExecuteParallelOptions& options)
+/*
+ * Loads all templates of the cache across the threads before matching starts, so that the first
+ * comparisons do not wait for them. Skipped with a cache budget, where the templates loaded first
+ * would only be evicted again; workers then load templates as they need them.
+ */
+static void preload(TemplateCache& cache, const ExecuteParallelOptions& options)
+{
+	if (cache.is_limited())
+	{
+		return;
+	}
+
+	std::vector<std::future<void>> tasks{};
+	tasks.reserve(cache.size());
+	ThreadPool pool{options.threads};
+	for (u32 id = 0; id < cache.size(); id++)
+	{
+		tasks.push_back(pool.enqueue([&cache, id]()
+		{
+			static_cast<void>(cache.get(id));
+		}));
+	}
+
+	const auto progress_step = std::max<std::size_t>(tasks.size() / 100, 1);
+	for (std::size_t i = 0; i < tasks.size(); i++)
+	{
+		tasks[i].get();
+		if (options.report_progress && ((i + 1) % progress_step == 0 || i + 1 == tasks.size()))
+		{
+			std::cerr << "\rinfo: loaded " << i + 1 << " of " << tasks.size() << " templates" << std::flush;
+		}
+	}
+	if (options.report_progress && !tasks.empty())
+	{
+		std::cerr << "\n";
+	}
+}
+
+static void execute_parallel_one_to_one(const ExecuteParallelOptions& options, TemplateCache& cache,
+                                        std::span<const u32> probe_ids, std::span<const u32> gallery_ids)
 {
-	std::map<std::string, CacheItem> cache{};
 	ThreadPool pool{options.threads};
 	std::vector<std::tuple<u32, u32, std::future<std::optional<Score>>>> tasks{};
 	tasks.reserve(options.chunk_size);
 
-	for (auto&& chunk : iter::chunked(iter::zip(iter::enumerate(options.probes), iter::enumerate(options.galleries)),
+	for (auto&& chunk : iter::chunked(iter::zip(iter::enumerate(probe_ids), iter::enumerate(gallery_ids)),
 	                                  options.chunk_size))
 	{
 		for (auto&& [probe_item, gallery_item] : chunk)
 		{
 			const auto& [probe_index, probe] = probe_item;
 			const auto& [gallery_index, gallery] = gallery_item;
-			const auto&& task = make_generic_executor(probe, gallery, cache, options.format, options.max_minutiae);
+			const auto&& task = make_generic_executor(probe, gallery, cache, options.format, options.threshold);
 			tasks.emplace_back(probe_index, gallery_index, pool.enqueue(std::move(task)));
 		}
 		for (auto&& [probe_index, gallery_index, task] : tasks)
@@ -260,22 +354,22 @@ static void execute_parallel_one_to_one(const ExecuteParallelOptions& options)
 }
 
 
-static void execute_parallel_many_to_many(const ExecuteParallelOptions& options)
+static void execute_parallel_many_to_many(const ExecuteParallelOptions& options, TemplateCache& cache,
+                                          std::span<const u32> probe_ids, std::span<const u32> gallery_ids)
 {
-	std::map<std::string, CacheItem> cache{};
 	ThreadPool pool{options.threads};
 	std::vector<std::tuple<u32, u32, std::future<std::optional<Score>>>> tasks{};
 	tasks.reserve(options.chunk_size);
 
 	for (auto&& chunk : iter::chunked(
-		     iter::product(iter::enumerate(options.probes), iter::enumerate(options.galleries)),
+		     iter::product(iter::enumerate(probe_ids), iter::enumerate(gallery_ids)),
 		     options.chunk_size))
 	{
 		for (auto&& [probe_item, gallery_item] : chunk)
 		{
 			const auto& [probe_index, probe] = probe_item;
 			const auto& [gallery_index, gallery] = gallery_item;
-			const auto&& task = make_generic_executor(probe, gallery, cache, options.format, options.max_minutiae);
+			const auto&& task = make_generic_executor(probe, gallery, cache, options.format, options.threshold);
 			tasks.emplace_back(probe_index, gallery_index, pool.enqueue(task));
 		}
 		for (auto&& [probe_index, gallery_index, task] : tasks)
@@ -295,131 +389,357 @@ static void execute_parallel_many_to_many(const ExecuteParallelOptions& options)
 }
 
 
-static void execute_parallel_one_to_many(const ExecuteParallelOptions& options)
+/*
+ * Matches the probe against the galleries chunk by chunk and returns the ones accepted by the score
+ * callback, in the order in which their scores were computed. With MatchMode::OnlyFirstMatch the rest
+ * of the comparisons are dropped once one gallery is accepted.
+ */
+static std::vector<std::pair<u32, std::optional<Score>>> match_one_to_many(
+	const ExecuteParallelOptions& options,
+	ThreadPool& pool,
+	TemplateCache& cache,
+	const TemplateRef& probe_template,
+	std::span<const u32> gallery_ids
+)
 {
-	std::map<std::string, CacheItem> cache{};
-	ThreadPool pool{options.threads};
-	std::vector<std::tuple<u32, std::future<void>>> tasks{};
-	tasks.reserve(options.chunk_size);
-	std::vector<std::pair<std::string, Score>> found_galleries{};
+	std::vector<std::pair<u32, std::optional<Score>>> found_galleries{};
+	bool is_done_for_probe = false;
 
-	for (auto&& [probe_index, probe] : iter::enumerate(options.probes))
+	for (auto&& chunk : iter::chunked(gallery_ids, options.chunk_size))
 	{
-		bool is_done_for_probe = false;
-		found_galleries.clear();
+		std::size_t done_tasks = 0;
+		std::size_t number_of_tasks = 0;
+		std::mutex mutex;
+		std::condition_variable all_done_or_found{};
 
-		const auto probe_cache = cache_data(cache, probe, options.max_minutiae);
-		if (!probe_cache.has_value())
+		for (auto&& gallery_id : chunk)
 		{
-			std::cerr << "error occurred when loading " << probe << "\n";
-			continue;
-		}
-
-		const auto& [probe_minutia, probe_edges] = probe_cache.value();
-
-		for (auto&& chunk : iter::chunked(iter::enumerate(options.galleries), options.chunk_size))
-		{
-			std::size_t done_tasks = 0;
-			std::mutex mutex;
-			std::condition_variable all_done_or_found{};
-
-			for (auto&& [gallery_index, gallery] : chunk)
+			auto task = [&, threshold = options.threshold, gallery_id = gallery_id]() -> auto
 			{
-				const auto gallery_cache = cache_data(cache, gallery, options.max_minutiae);
-				if (!gallery_cache.has_value())
-				{
-					std::cerr << "error occurred when loading " << gallery << "\n";
-					continue;
-				}
+				const auto gallery_template = cache.get(gallery_id);
+				const auto score = gallery_template.has_value()
+					                   ? match_templates(probe_template, gallery_template.value(), options.format,
+					                                     threshold)
+					                   : std::nullopt;
 
-				const auto& [gallery_minutia, gallery_edges] = gallery_cache.value();
-				auto task = [&,
-						format = options.format,
-						probe_minutia = probe_minutia,
-						probe_edges = probe_edges,
-						gallery = gallery,
-						gallery_minutia = gallery_minutia,
-						gallery_edges = gallery_edges
-					]() -> auto
 				{
-					const auto score = match(probe_minutia, probe_edges, gallery_minutia, gallery_edges,
-					                         bz3::Format::NistInternal);
-
+					std::lock_guard guard{mutex};
+					if (!score.has_value())
 					{
-						std::lock_guard guard{mutex};
-						if (options.score_callback(std::make_optional(score)))
+						std::cerr << "error occurred when loading " << cache.name(gallery_id) << "\n";
+					}
+					if (options.score_callback(score))
+					{
+						found_galleries.emplace_back(gallery_id, score);
+						if (options.match_mode == MatchMode::OnlyFirstMatch)
 						{
-							found_galleries.emplace_back(gallery, score);
-							if (options.match_mode == MatchMode::OnlyFirstMatch)
-							{
-								is_done_for_probe = true;
-							}
+							is_done_for_probe = true;
 						}
-
-						done_tasks += 1;
 					}
 
-					all_done_or_found.notify_all();
-				};
-				tasks.emplace_back(gallery_index, pool.enqueue(task));
-			}
+					done_tasks += 1;
+				}
 
-			std::unique_lock lock{mutex};
-			all_done_or_found.wait(lock, [&]()
-			{
-				return done_tasks == tasks.size() || is_done_for_probe;
-			});
-			lock.unlock();
+				all_done_or_found.notify_all();
+			};
+			pool.enqueue(task);
+			number_of_tasks++;
+		}
 
-			pool.drain();
-			tasks.clear();
+		std::unique_lock lock{mutex};
+		all_done_or_found.wait(lock, [&]()
+		{
+			return done_tasks == number_of_tasks || is_done_for_probe;
+		});
+		lock.unlock();
 
-			if (is_done_for_probe)
-			{
-				break;
-			}
+		pool.drain();
+
+		if (is_done_for_probe)
+		{
+			break;
 		}
+	}
 
-		if (found_galleries.empty())
+	return found_galleries;
+}
+
+static void report_one_to_many(const ExecuteParallelOptions& options, const TemplateCache& cache,
+                               const std::string& probe,
+                               std::span<const std::pair<u32, std::optional<Score>>> found_galleries)
+{
+	if (found_galleries.empty())
+	{
+		options.match_callback(probe, "-", std::nullopt);
+	}
+	else if (options.match_mode == MatchMode::OnlyFirstMatch)
+	{
+		const auto& [gallery, score] = found_galleries[0];
+		options.match_callback(probe, cache.name(gallery), score);
+	}
+	else
+	{
+		for (const auto& [gallery, score] : found_galleries)
 		{
-			options.match_callback(options.probes[probe_index], "-", std::nullopt);
+			options.match_callback(probe, cache.name(gallery), score);
 		}
-		else
+	}
+}
+
+static void execute_parallel_one_to_many(const ExecuteParallelOptions& options, TemplateCache& cache,
+                                         std::span<const u32> probe_ids, std::span<const u32> gallery_ids)
+{
+	ThreadPool pool{options.threads};
+
+	for (auto&& [probe_index, probe] : iter::enumerate(options.probes))
+	{
+		// kept for all the chunks of the probe, so that it cannot be evicted meanwhile
+		const auto probe_template = cache.get(probe_ids[probe_index]);
+		if (!probe_template.has_value())
 		{
-			if (options.match_mode == MatchMode::OnlyFirstMatch)
-			{
-				const auto& [gallery, score] = found_galleries[0];
-				options.match_callback(probe, gallery, std::make_optional(score));
-			}
-			else
-			{
-				for (const auto& [gallery, score] : found_galleries)
-				{
-					options.match_callback(probe, gallery, std::make_optional(score));
-				}
-			}
+			std::cerr << "error occurred when loading " << probe << "\n";
+			continue;
 		}
+
+		const auto found_galleries = match_one_to_many(options, pool, cache, probe_template.value(), gallery_ids);
+		report_one_to_many(options, cache, probe, found_galleries);
 	}
 }
 
 
+static void report_cache(const TemplateCache& cache)
+{
+	std::cerr << "info: template cache: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+		<< cache.evictions() << " evictions\n";
+}
+
 static void execute_parallel(
 	CompareMode compare_mode,
 	const ExecuteParallelOptions& options
 )
 {
+	TemplateCache cache{options.max_minutiae, options.format, options.cache_budget};
+	const auto probe_ids = cache.intern(options.probes);
+	const auto gallery_ids = cache.intern(options.galleries);
+	preload(cache, options);
+
 	switch (compare_mode)
 	{
 	case CompareMode::OneToOne:
-		execute_parallel_one_to_one(options);
+		execute_parallel_one_to_one(options, cache, probe_ids, gallery_ids);
 		break;
 	case CompareMode::ManyToMany:
-		execute_parallel_many_to_many(options);
+		execute_parallel_many_to_many(options, cache, probe_ids, gallery_ids);
 		break;
 	case CompareMode::OneToMany:
-		execute_parallel_one_to_many(options);
+		execute_parallel_one_to_many(options, cache, probe_ids, gallery_ids);
 		break;
 	}
+
+	if (options.report_progress || cache.is_limited())
+	{
+		report_cache(cache);
+	}
+}
+
+struct StreamFrame
+{
+	std::string name{};
+	u32 number_of_minutiae{};
+	std::optional<std::string> gallery{};
+};
+
+// "template NAME COUNT [GALLERY]"
+static std::optional<StreamFrame> parse_stream_frame(std::string_view line)
+{
+	std::vector<std::string_view> fields{};
+	while (!line.empty())
+	{
+		const auto first = line.find_first_not_of(" \t\r");
+		if (first == std::string_view::npos)
+		{
+			break;
+		}
+		line.remove_prefix(first);
+		const auto length = std::min(line.find_first_of(" \t\r"), line.size());
+		fields.push_back(line.substr(0, length));
+		line.remove_prefix(length);
+	}
+
+	if (fields.size() < 3 || fields.size() > 4 || fields[0] != "template")
+	{
+		return std::nullopt;
+	}
+
+	StreamFrame frame{.name = std::string{fields[1]}};
+	const auto& count = fields[2];
+	if (const auto [end, error] = std::from_chars(count.data(), count.data() + count.size(),
+	                                              frame.number_of_minutiae);
+		error != std::errc{} || end != count.data() + count.size())
+	{
+		return std::nullopt;
+	}
+	if (fields.size() == 4)
+	{
+		frame.gallery = std::string{fields[3]};
+	}
+	return frame;
+}
+
+/*
+ * Reads probe templates from the input and matches every one against the galleries, which are loaded
+ * only once. A frame is the line "template NAME COUNT [GALLERY]" followed by COUNT lines of minutiae as
+ * in .xyt files; with GALLERY the probe is compared only with that template of the galleries. Results
+ * are written like for files, in the order of the galleries, and every response ends with an empty
+ * line and is flushed, so that the writer of the input can wait for it before sending the next frame.
+ */
+static bool execute_stream(const ExecuteParallelOptions& options, std::istream& input, ResultWriter& output)
+{
+	TemplateCache cache{options.max_minutiae, options.format, options.cache_budget};
+	const auto gallery_ids = cache.intern(options.galleries);
+	preload(cache, options);
+
+	ThreadPool pool{options.threads};
+	std::string line{};
+	std::string text{};
+	u64 line_number = 0;
+	bool is_valid = true;
+
+	while (std::getline(input, line))
+	{
+		line_number++;
+		if (line.find_first_not_of(" \t\r") == std::string::npos)
+		{
+			continue;
+		}
+
+		const auto frame = parse_stream_frame(line);
+		if (!frame.has_value())
+		{
+			std::cerr << "error: stdin:" << line_number << ": malformed frame header '" << line << "'\n";
+			is_valid = false;
+			break;
+		}
+
+		text.clear();
+		u32 read_lines = 0;
+		for (; read_lines < frame->number_of_minutiae && std::getline(input, line); read_lines++)
+		{
+			text.append(line).push_back('\n');
+		}
+		line_number += read_lines;
+		if (read_lines < frame->number_of_minutiae)
+		{
+			std::cerr << "error: stdin:" << line_number << ": template " << frame->name << " is truncated\n";
+			is_valid = false;
+			break;
+		}
+
+		std::vector<u32> selected_gallery{};
+		if (frame->gallery.has_value())
+		{
+			if (const auto id = cache.find(frame->gallery.value()); id.has_value())
+			{
+				selected_gallery.push_back(id.value());
+			}
+			else
+			{
+				std::cerr << "error: template " << frame->gallery.value() << " is not among the galleries\n";
+			}
+		}
+
+		auto minutiae = parse_xyt(text, frame->name);
+		if (!minutiae.has_value() || (frame->gallery.has_value() && selected_gallery.empty()))
+		{
+			options.match_callback(frame->name, "-", std::nullopt);
+		}
+		else
+		{
+			const auto [probe_minutiae, probe_edges] =
+				prepare_minutiae(minutiae.value(), options.max_minutiae, options.format);
+			const Edges probe_arrays{probe_edges};
+			const auto probe_template = TemplateRef{.minutiae = probe_minutiae, .edges = probe_arrays.view()};
+
+			auto found_galleries = match_one_to_many(
+				options, pool, cache, probe_template,
+				frame->gallery.has_value() ? std::span<const u32>{selected_gallery} : gallery_ids
+			);
+			if (options.match_mode != MatchMode::OnlyFirstMatch)
+			{
+				std::sort(found_galleries.begin(), found_galleries.end(), [](const auto& a, const auto& b)
+				{
+					return a.first < b.first;
+				});
+			}
+			report_one_to_many(options, cache, frame->name, found_galleries);
+		}
+
+		output.write('\n');
+		output.flush();
+	}
+
+	if (options.report_progress || cache.is_limited())
+	{
+		report_cache(cache);
+	}
+	return is_valid;
+}
+
+/*
+ * Computes the scores of all probes against all galleries straight into the cells of the matrix.
+ * Every worker takes the next block of a row until none is left, so nothing is queued and the scores
+ * are stored in whatever order they are computed.
+ */
+static void execute_into_matrix(const ExecuteParallelOptions& options, ScoreMatrix& matrix)
+{
+	TemplateCache cache{options.max_minutiae, options.format, options.cache_budget};
+	const auto probe_ids = cache.intern(options.probes);
+	const auto gallery_ids = cache.intern(options.galleries);
+	preload(cache, options);
+
+	const u64 blocks_per_row = (gallery_ids.size() + options.chunk_size - 1) / options.chunk_size;
+	const u64 number_of_blocks = probe_ids.size() * blocks_per_row;
+	std::atomic<u64> next_block{0};
+
+	const auto work = [&]()
+	{
+		for (auto block = next_block.fetch_add(1, std::memory_order_relaxed); block < number_of_blocks;
+		     block = next_block.fetch_add(1, std::memory_order_relaxed))
+		{
+			const auto row = block / blocks_per_row;
+			const auto first = block % blocks_per_row * options.chunk_size;
+			const auto last = std::min<u64>(first + options.chunk_size, gallery_ids.size());
+
+			const auto probe_template = cache.get(probe_ids[row]);
+			for (auto column = first; column < last; column++)
+			{
+				const auto gallery_template = probe_template.has_value()
+					                              ? cache.get(gallery_ids[column])
+					                              : std::nullopt;
+				matrix.set(row, column, gallery_template.has_value()
+					                        ? match_templates(probe_template.value(), gallery_template.value(),
+					                                          options.format, options.threshold)
+					                        : std::nullopt);
+			}
+		}
+	};
+
+	ThreadPool pool{options.threads};
+	std::vector<std::future<void>> workers{};
+	workers.reserve(options.threads);
+	for (u32 i = 0; i < options.threads; i++)
+	{
+		workers.push_back(pool.enqueue(work));
+	}
+	for (auto& worker : workers)
+	{
+		worker.get();
+	}
+
+	if (options.report_progress || cache.is_limited())
+	{
+		report_cache(cache);
+	}
 }
 
 static void execute_sequential(
@@ -430,30 +750,29 @@ static void execute_sequential(
 	const ScoreCallback& score_callback,
 	const MatchCallback& match_callback,
 	u32 max_minutiae,
-	bz3::Format format
+	bz3::Format format,
+	std::optional<u32> threshold,
+	std::size_t cache_budget
 )
 {
-	std::map<std::string, std::pair<std::vector<Minutia>, std::vector<Edge>>> cache{};
+	TemplateCache cache{max_minutiae, format, cache_budget};
+	const auto probe_ids = cache.intern(probes);
+	const auto gallery_ids = cache.intern(galleries);
 
-	auto execute = [&](const std::string& probe, const std::string& gallery) -> std::optional<Score>
+	auto execute = [&](u32 probe, u32 gallery) -> std::optional<Score>
 	{
-		const auto& gallery_cache = cache_data(cache, gallery, max_minutiae);
-		const auto& probe_cache = cache_data(cache, probe, max_minutiae);
-
-		if (gallery_cache.has_value() && probe_cache.has_value())
+		const auto gallery_template = cache.get(gallery);
+		const auto probe_template = cache.get(probe);
+		if (gallery_template.has_value() && probe_template.has_value())
 		{
-			const auto& [gallery_minutia, gallery_edges] = gallery_cache.value();
-			const auto& [probe_minutia, probe_edges] = probe_cache.value();
-			const auto score = match(probe_minutia, probe_edges, gallery_minutia, gallery_edges,
-			                         bz3::Format::NistInternal);
-			return std::make_optional(score);
+			return match_templates(probe_template.value(), gallery_template.value(), format, threshold);
 		}
 		return std::nullopt;
 	};
 
 	if (compare_mode == CompareMode::OneToOne)
 	{
-		for (auto&& [probe_item, gallery_item] : iter::zip(iter::enumerate(probes), iter::enumerate(galleries)))
+		for (auto&& [probe_item, gallery_item] : iter::zip(iter::enumerate(probe_ids), iter::enumerate(gallery_ids)))
 		{
 			const auto& [probe_index, probe] = probe_item;
 			const auto& [gallery_index, gallery] = gallery_item;
@@ -470,7 +789,8 @@ static void execute_sequential(
 	}
 	else if (compare_mode == CompareMode::ManyToMany)
 	{
-		for (auto&& [probe_item, gallery_item] : iter::product(iter::enumerate(probes), iter::enumerate(galleries)))
+		for (auto&& [probe_item, gallery_item] : iter::product(iter::enumerate(probe_ids),
+		                                                       iter::enumerate(gallery_ids)))
 		{
 			const auto& [probe_index, probe] = probe_item;
 			const auto& [gallery_index, gallery] = gallery_item;
@@ -487,9 +807,9 @@ static void execute_sequential(
 	}
 	else if (compare_mode == CompareMode::OneToMany)
 	{
-		for (auto&& [probe_index, probe] : iter::enumerate(probes))
+		for (auto&& [probe_index, probe] : iter::enumerate(probe_ids))
 		{
-			for (auto&& [gallery_index, gallery] : iter::enumerate(galleries))
+			for (auto&& [gallery_index, gallery] : iter::enumerate(gallery_ids))
 			{
 				const auto score = execute(probe, gallery);
 				if (score_callback(score))
@@ -503,8 +823,12 @@ static void execute_sequential(
 			}
 		}
 	}
-}
 
+	if (cache.is_limited())
+	{
+		report_cache(cache);
+	}
+}
 
 static std::optional<Range> parse_range(const std::string& value)
 {
@@ -580,8 +904,52 @@ static void run(
 	const Options& options
 )
 {
-	const auto execute_into_stream = [&](std::ostream& output)
+	const auto format = options.use_ansi ? bz3::Format::Ansi : bz3::Format::NistInternal;
+	const auto threshold = options.early_exit
+		                       ? std::make_optional(static_cast<u32>(std::max(options.threshold, 0)))
+		                       : std::nullopt;
+	const auto cache_budget = options.cache_mb > 0
+		                          ? static_cast<std::size_t>(options.cache_mb) << 20
+		                          : TemplateCache::UNLIMITED;
+
+	for (const auto& pack : options.template_packs)
+	{
+		use_template_pack(pack);
+	}
+
+	if (options.output_format == OutputFormat::Matrix)
+	{
+		auto matrix = ScoreMatrix::create(options.output_file.value(), probes, galleries);
+		if (matrix == nullptr)
+		{
+			exit(1);
+		}
+
+		ExecuteParallelOptions execute_options{
+			options.mode,
+			probes,
+			galleries,
+			{},
+			{},
+			static_cast<u32>(options.max_minutiae),
+			format,
+			options.threads,
+			threshold,
+			options.report_progress,
+			cache_budget
+		};
+		execute_into_matrix(execute_options, *matrix);
+		if (!matrix->close())
+		{
+			exit(1);
+		}
+		return;
+	}
+
+	bool is_valid = true;
+	const auto execute_into_stream = [&](std::ostream& stream)
 	{
+		ResultWriter output{stream};
 		const auto score_callback = [&](const auto score) -> CallbackResult
 		{
 			if (options.mode == MatchMode::All)
@@ -591,20 +959,12 @@ static void run(
 			return score.has_value() && score.value() >= options.threshold;
 		};
 
-		const auto match_callback = [&](const auto probe, const auto gallery, const auto score)
+		const auto match_callback = [&](const auto& probe, const auto& gallery, const auto score)
 		{
-			if (options.mode == MatchMode::All && options.only_scores)
-			{
-				output << score.value_or(-1) << "\n";
-			}
-			else
-			{
-				output << probe << " " << gallery << " " << score.value_or(-1) << "\n";
-			}
+			output.write_result(probe, gallery, score, options.mode == MatchMode::All && options.only_scores);
 		};
 
-		const auto format = options.use_ansi ? bz3::Format::Ansi : bz3::Format::NistInternal;
-		if (options.threads > 1)
+		if (options.stream || options.threads > 1)
 		{
 			ExecuteParallelOptions execute_options{
 				options.mode,
@@ -614,15 +974,25 @@ static void run(
 				match_callback,
 				static_cast<u32>(options.max_minutiae),
 				format,
-				options.threads
+				options.threads,
+				threshold,
+				options.report_progress,
+				cache_budget
 			};
-			execute_parallel(mode, execute_options);
+			if (options.stream)
+			{
+				is_valid = execute_stream(execute_options, std::cin, output);
+			}
+			else
+			{
+				execute_parallel(mode, execute_options);
+			}
 		}
 		else
 		{
 			execute_sequential(
 				mode, options.mode, probes, galleries, score_callback, match_callback,
-				static_cast<u32>(options.max_minutiae), format
+				static_cast<u32>(options.max_minutiae), format, threshold, cache_budget
 			);
 		}
 	};
@@ -641,6 +1011,65 @@ static void run(
 	{
 		execute_into_stream(std::cout);
 	}
+
+	if (options.early_exit)
+	{
+		std::cerr << "info: " << count_early_rejects() << " comparisons rejected before clustering\n";
+	}
+
+	if (!is_valid)
+	{
+		exit(1);
+	}
+}
+
+// options of how templates are prepared, shared by matching and the convert and pack subcommands
+struct TemplateOptions
+{
+	bool use_ansi = false;
+	int max_minutiae = 150;
+	int threads = 0;
+
+	[[nodiscard]] bz3::Format format() const { return use_ansi ? bz3::Format::Ansi : bz3::Format::NistInternal; }
+};
+
+static void add_template_options(cxxopts::OptionAdder&& adder, TemplateOptions& template_options)
+{
+	const auto max_threads = std::thread::hardware_concurrency();
+	adder
+		("a,ansi", "all *.xyt files use representation according to ANSI INCITS 378-2004",
+		 cxxopts::value<bool>(template_options.use_ansi)->default_value("false"))
+		("n,max-minutiae",
+		 "set maximum number of minutiae to use from any file; allowed range 0-200",
+		 cxxopts::value<int>(template_options.max_minutiae)->default_value("150"))
+		("T,threads", "number of threads to use; supported values: 1-" + std::to_string(max_threads),
+		 cxxopts::value<int>(template_options.threads)->default_value(std::to_string(max_threads)));
+}
+
+static void check_template_options(const TemplateOptions& template_options, std::vector<std::string>& errors)
+{
+	if (template_options.max_minutiae < MIN_BOZORTH_MINUTIAE || template_options.max_minutiae > MAX_BOZORTH_MINUTIAE)
+	{
+		errors.emplace_back("invalid number of computable minutiae");
+	}
+
+	if (template_options.threads <= 0 || template_options.threads > std::thread::hardware_concurrency())
+	{
+		errors.emplace_back("invalid number of threads");
+	}
+}
+
+static void exit_on_parsing_errors(const std::vector<std::string>& errors)
+{
+	if (!errors.empty())
+	{
+		std::cerr << "Parsing errors: \n";
+		for (const auto& error : errors)
+		{
+			std::cerr << " - " << error << "\n";
+		}
+		exit(1);
+	}
 }
 
 cxxopts::ParseResult
@@ -657,48 +1086,59 @@ parse(int argc, const char* argv[])
 		std::string gallery_range{};
 		std::string match_mode{};
 		std::string output_file{};
-		int threads{};
-		const auto max_threads = std::thread::hardware_concurrency();
+		std::string output_format{};
+		TemplateOptions template_options{};
 
 		options.add_options("Input")
 			("M,pair-list", "file containing list of pairs to compare, one file in each line",
 			 cxxopts::value<std::string>(opt.pair_file))
 			("p,probe", "single probe file", cxxopts::value<std::string>(opt.fixed_probe))
-			("P,probe-list", "file containing list of probe files or directory",
+			("P,probe-list", "file containing list of probe files, directory or template pack",
 			 cxxopts::value<std::string>(opt.probe_files))
 			("g,gallery", "single gallery file", cxxopts::value<std::string>(opt.fixed_gallery))
-			("G,gallery-list", "file containing list of gallery files or directory",
+			("G,gallery-list", "file containing list of gallery files, directory or template pack",
 			 cxxopts::value<std::string>(opt.gallery_files))
 
 			("positional", "list of files", cxxopts::value<std::vector<std::string>>())
 			("probe-range", "subset of files in the probe list to process",
 			 cxxopts::value<std::string>(probe_range))
 			("gallery-range", "subset of files in the gallery file to process",
-			 cxxopts::value<std::string>(gallery_range));
+			 cxxopts::value<std::string>(gallery_range))
+			("stream", "match probe templates read from the standard input against the galleries; every "
+			 "template is sent as the line 'template NAME COUNT [GALLERY]' followed by COUNT lines of .xyt "
+			 "minutiae, and every response ends with an empty line",
+			 cxxopts::value<bool>(opt.stream)->default_value("false"));
 
 		options.add_options("Output")
 			("s,only-scores", "print only scores without filenames (applicable only for -m 'all')",
 			 cxxopts::value<bool>(opt.only_scores)->default_value("false"))
-			("o,output", "output file", cxxopts::value<std::string>(output_file)->default_value("-"));
+			("o,output", "output file", cxxopts::value<std::string>(output_file)->default_value("-"))
+			("output-format", "format of the output file; supported formats: text, matrix (binary matrix of "
+			 "16-bit scores of all probes against all galleries, only for -m 'all' with probes and galleries)",
+			 cxxopts::value<std::string>(output_format)->default_value("text"));
 
 		options.add_options("Mode")
 		("m,match-mode",
 		 "matching mode; supported modes: all, first-match, all-matches",
 		 cxxopts::value<std::string>(match_mode)->default_value("all"))
 		("t,threshold", "set match score threshold",
-		 cxxopts::value<int>(opt.threshold)->default_value("40"));
+		 cxxopts::value<int>(opt.threshold)->default_value("40"))
+		("e,early-exit",
+		 "stop computing a score once it is known whether it reaches the threshold; printed scores are then "
+		 "bounds (not applicable for -m 'all')",
+		 cxxopts::value<bool>(opt.early_exit)->default_value("false"));
 
+		add_template_options(options.add_options("Miscellaneous"), template_options);
 		options.add_options("Miscellaneous")
-			("a,ansi", "all *.xyt files use representation according to ANSI INCITS 378-2004",
-			 cxxopts::value<bool>(opt.use_ansi)->default_value("false"))
-			("n,max-minutiae",
-			 "set maximum number of minutiae to use from any file; allowed range 0-200",
-			 cxxopts::value<int>(opt.max_minutiae)->default_value("150"))
-
-			("T,threads", "number of threads to use; supported values: 1-" + std::to_string(max_threads),
-			 cxxopts::value<int>(threads)->default_value(std::to_string(std::thread::hardware_concurrency())))
 			("d,dry", "only print the filenames between which match scores would be computed",
 			 cxxopts::value<bool>(opt.dry_run))
+			("progress", "report progress of loading templates before matching with more than one thread",
+			 cxxopts::value<bool>(opt.report_progress)->default_value("false"))
+			("cache-mb", "memory budget of loaded templates in MiB; least recently used ones are evicted; "
+			 "0 keeps all of them",
+			 cxxopts::value<int>(opt.cache_mb)->default_value("0"))
+			("template-cache", "directory in which prepared templates are kept and reused between runs",
+			 cxxopts::value<std::string>(opt.template_cache))
 
 			("h,help", "print this help");
 
@@ -713,9 +1153,24 @@ parse(int argc, const char* argv[])
 		}
 
 		std::vector<std::string> errors{};
-		if (opt.max_minutiae < MIN_BOZORTH_MINUTIAE || opt.max_minutiae > MAX_BOZORTH_MINUTIAE)
+		check_template_options(template_options, errors);
+
+		if (opt.cache_mb < 0)
 		{
-			errors.emplace_back("invalid number of computable minutiae");
+			errors.emplace_back("invalid cache size");
+		}
+
+		if (result.count("template-cache"))
+		{
+			if (std::error_code error{}; !fs::is_directory(opt.template_cache, error) &&
+				!fs::create_directories(opt.template_cache, error))
+			{
+				errors.emplace_back("cannot create template cache directory '" + opt.template_cache + "'");
+			}
+			else
+			{
+				use_template_cache_directory(opt.template_cache);
+			}
 		}
 
 		const auto use_probe_range = result.count("probe-range");
@@ -746,23 +1201,6 @@ parse(int argc, const char* argv[])
 			}
 		}
 
-		const auto use_threads = result.count("threads");
-		if (use_threads)
-		{
-			if (threads > 0 && threads <= max_threads)
-			{
-				opt.threads = static_cast<u32>(threads);
-			}
-			else
-			{
-				errors.emplace_back("invalid number of threads");
-			}
-		}
-		else
-		{
-			opt.threads = std::thread::hardware_concurrency();
-		}
-
 		if (match_mode == "all")
 		{
 			opt.mode = MatchMode::All;
@@ -824,26 +1262,86 @@ parse(int argc, const char* argv[])
 			errors.emplace_back(R"(flag "-M" is not compatible with modes other than "all")");
 		}
 
-		if (!errors.empty())
+		if (opt.mode == MatchMode::All && opt.early_exit)
+		{
+			errors.emplace_back(R"(flag "-e" is not compatible with mode "all")");
+		}
+
+		if (opt.stream && (use_pair_list || use_probe_list || use_probe || use_probe_range))
+		{
+			errors.emplace_back(R"(flag "--stream" is not compatible with other probes)");
+		}
+
+		if (opt.stream && use_dry_run)
 		{
-			std::cerr << "Parsing errors: \n";
-			for (const auto& error : errors)
+			errors.emplace_back(R"(flags "--stream" and "-d" are incompatible)");
+		}
+
+		if (output_format == "text")
+		{
+			opt.output_format = OutputFormat::Text;
+		}
+		else if (output_format == "matrix")
+		{
+			opt.output_format = OutputFormat::Matrix;
+			if (!use_output_file || output_file == "-")
 			{
-				std::cerr << " - " << error << "\n";
+				errors.emplace_back(R"(output format "matrix" requires an output file "-o")");
 			}
-			exit(1);
+			if (opt.mode != MatchMode::All || use_pair_list || opt.stream)
+			{
+				errors.emplace_back(
+					R"(output format "matrix" is only supported for mode "all" with probes and galleries)");
+			}
+		}
+		else
+		{
+			errors.emplace_back("unsupported output format '" + output_format + "'");
 		}
 
+		exit_on_parsing_errors(errors);
+
+		opt.use_ansi = template_options.use_ansi;
+		opt.max_minutiae = template_options.max_minutiae;
+		opt.threads = static_cast<u32>(template_options.threads);
+
 		if (use_output_file)
 		{
 			opt.output_file = std::make_optional(output_file);
 		}
 
+		const auto get_items = [&](const std::string& path)
+		{
+			return is_template_pack(path)
+				       ? get_items_from_pack(path, opt)
+				       : get_items_from_file_or_directory(path);
+		};
+
 		CompareMode mode = opt.mode == MatchMode::All ? CompareMode::ManyToMany : CompareMode::OneToMany;
 		std::vector<std::string> probes{};
 		std::vector<std::string> galleries{};
 
-		if (use_pair_list)
+		if (opt.stream)
+		{
+			if (use_gallery_list)
+			{
+				galleries = get_items(opt.gallery_files);
+			}
+			else if (use_gallery)
+			{
+				galleries = {opt.fixed_gallery};
+			}
+			else if (use_positional)
+			{
+				galleries = result["positional"].as<std::vector<std::string>>();
+			}
+			else
+			{
+				std::cerr << "error: missing gallery files\n";
+				exit(1);
+			}
+		}
+		else if (use_pair_list)
 		{
 			std::tie(probes, galleries) = find_items_from_pairs(opt.pair_file);
 			mode = CompareMode::OneToOne;
@@ -858,7 +1356,7 @@ parse(int argc, const char* argv[])
 			probes = {opt.fixed_probe};
 			if (use_gallery_list)
 			{
-				galleries = get_items_from_file_or_directory(opt.gallery_files);
+				galleries = get_items(opt.gallery_files);
 			}
 			else if (use_positional)
 			{
@@ -875,7 +1373,7 @@ parse(int argc, const char* argv[])
 			galleries = {opt.fixed_gallery};
 			if (use_probe_list)
 			{
-				probes = get_items_from_file_or_directory(opt.probe_files);
+				probes = get_items(opt.probe_files);
 			}
 			else if (use_positional)
 			{
@@ -889,18 +1387,18 @@ parse(int argc, const char* argv[])
 		}
 		else if (use_probe_list && use_gallery_list)
 		{
-			probes = get_items_from_file_or_directory(opt.probe_files);
-			galleries = get_items_from_file_or_directory(opt.gallery_files);
+			probes = get_items(opt.probe_files);
+			galleries = get_items(opt.gallery_files);
 		}
 		else if (use_probe_list && use_positional)
 		{
-			probes = get_items_from_file_or_directory(opt.probe_files);
+			probes = get_items(opt.probe_files);
 			galleries = result["positional"].as<std::vector<std::string>>();
 		}
 		else if (use_gallery_list && use_positional)
 		{
 			probes = result["positional"].as<std::vector<std::string>>();
-			galleries = get_items_from_file_or_directory(opt.gallery_files);
+			galleries = get_items(opt.gallery_files);
 		}
 		else if (use_positional)
 		{
@@ -928,6 +1426,12 @@ parse(int argc, const char* argv[])
 			exit(1);
 		}
 
+		if (opt.output_format == OutputFormat::Matrix && mode != CompareMode::ManyToMany)
+		{
+			std::cerr << "error: output format \"matrix\" requires probes and galleries\n";
+			exit(1);
+		}
+
 		std::span<std::string> probes_range = std::span(probes);
 		if (opt.probe_range.has_value())
 		{
@@ -977,8 +1481,280 @@ parse(int argc, const char* argv[])
 }
 
 
+// expands the directories and lists of files given to a subcommand into the files it accepts
+template <typename Predicate>
+static std::vector<std::string> collect_files(const std::vector<std::string>& items, Predicate accept)
+{
+	std::vector<std::string> files{};
+	for (const auto& item : items)
+	{
+		if (is_minutiae_record(item) && !split_finger_view(item).second.has_value())
+		{
+			for (auto&& view : list_finger_views(item))
+			{
+				files.push_back(std::move(view));
+			}
+			continue;
+		}
+		if (accept(item))
+		{
+			files.push_back(item);
+			continue;
+		}
+		for (auto&& file : get_items_from_file_or_directory(item))
+		{
+			if (accept(file))
+			{
+				files.push_back(std::move(file));
+			}
+		}
+	}
+	return files;
+}
+
+// converts .xyt files and finger minutiae records into .bzt template files with the same names in the output directory
+static int convert(int argc, const char* argv[])
+{
+	try
+	{
+		cxxopts::Options options(std::string{argv[0]} + " convert");
+		options.positional_help("[.xyt or .fmr files, directories or lists of files]");
+
+		std::string output_directory{};
+		TemplateOptions template_options{};
+
+		options.add_options()
+			("O,output-directory", "directory for the converted files",
+			 cxxopts::value<std::string>(output_directory));
+		add_template_options(options.add_options(), template_options);
+		options.add_options()
+			("positional", "list of files", cxxopts::value<std::vector<std::string>>())
+			("h,help", "print this help");
+
+		options.parse_positional({"positional"});
+
+		auto result = options.parse(argc, argv);
+
+		if (result.count("help"))
+		{
+			std::cout << options.help() << std::endl;
+			exit(0);
+		}
+
+		std::vector<std::string> errors{};
+		check_template_options(template_options, errors);
+
+		if (!result.count("output-directory"))
+		{
+			errors.emplace_back(R"(missing output directory "-O")");
+		}
+		else if (!fs::is_directory(output_directory))
+		{
+			errors.emplace_back("output directory '" + output_directory + "' does not exist");
+		}
+
+		if (!result.count("positional"))
+		{
+			errors.emplace_back("missing input data");
+		}
+
+		exit_on_parsing_errors(errors);
+
+		const auto files = collect_files(result["positional"].as<std::vector<std::string>>(),
+		                                 [](const std::string& file)
+		                                 {
+			                                 return ends_with(file, ".xyt") || is_minutiae_record(file);
+		                                 });
+
+		// every finger view of a record gets its own file, e.g. "record#1.bzt"
+		std::vector<fs::path> targets{};
+		targets.reserve(files.size());
+		std::map<fs::path, std::size_t> sources{};
+		bool collides = false;
+		for (std::size_t i = 0; i < files.size(); i++)
+		{
+			const auto [path, view] = split_finger_view(files[i]);
+			auto target = fs::path{output_directory} / fs::path{path}.filename();
+			target.replace_extension();
+			if (view.has_value())
+			{
+				target += FINGER_VIEW_SEPARATOR + std::to_string(view.value());
+			}
+			target += TEMPLATE_FILE_EXTENSION;
+
+			if (const auto [it, inserted] = sources.emplace(target, i); !inserted)
+			{
+				std::cerr << "error: " << files[it->second] << " and " << files[i] << " would both be converted to "
+					<< target.string() << "\n";
+				collides = true;
+			}
+			targets.push_back(std::move(target));
+		}
+		if (collides)
+		{
+			return 1;
+		}
+
+		const auto format = template_options.format();
+		const auto max_minutiae = static_cast<u32>(template_options.max_minutiae);
+		std::atomic<u32> failed{0};
+		{
+			ThreadPool pool{static_cast<u32>(template_options.threads)};
+			std::vector<std::future<void>> tasks{};
+			tasks.reserve(files.size());
+			for (std::size_t i = 0; i < files.size(); i++)
+			{
+				tasks.push_back(pool.enqueue([&, i]()
+				{
+					const auto data = prepare_data(files[i], max_minutiae, format);
+					if (!data.has_value() ||
+						!save_template(targets[i].string(), data->first, data->second, max_minutiae, format))
+					{
+						failed.fetch_add(1, std::memory_order_relaxed);
+					}
+				}));
+			}
+			for (auto& task : tasks)
+			{
+				task.get();
+			}
+		}
+
+		std::cerr << "converted " << files.size() - failed.load() << " of " << files.size() << " files\n";
+		return failed.load() == 0 ? 0 : 1;
+	}
+	catch (const cxxopts::exceptions::parsing& e)
+	{
+		std::cout << "error parsing options: " << e.what() << std::endl;
+		exit(1);
+	}
+}
+
+// stores .xyt, .fmr and .bzt files in a single template pack, under the names they are given with
+static int pack(int argc, const char* argv[])
+{
+	try
+	{
+		cxxopts::Options options(std::string{argv[0]} + " pack");
+		options.positional_help("[.xyt, .fmr or .bzt files, directories or lists of files]");
+
+		std::string output_file{};
+		TemplateOptions template_options{};
+
+		options.add_options()
+			("o,output", "template pack to create", cxxopts::value<std::string>(output_file));
+		add_template_options(options.add_options(), template_options);
+		options.add_options()
+			("positional", "list of files", cxxopts::value<std::vector<std::string>>())
+			("h,help", "print this help");
+
+		options.parse_positional({"positional"});
+
+		auto result = options.parse(argc, argv);
+
+		if (result.count("help"))
+		{
+			std::cout << options.help() << std::endl;
+			exit(0);
+		}
+
+		std::vector<std::string> errors{};
+		check_template_options(template_options, errors);
+
+		if (!result.count("output"))
+		{
+			errors.emplace_back(R"(missing output file "-o")");
+		}
+		else if (!is_template_pack(output_file))
+		{
+			errors.emplace_back("output file '" + output_file + "' does not have extension " +
+				std::string{TEMPLATE_PACK_EXTENSION});
+		}
+
+		if (!result.count("positional"))
+		{
+			errors.emplace_back("missing input data");
+		}
+
+		exit_on_parsing_errors(errors);
+
+		const auto files = collect_files(result["positional"].as<std::vector<std::string>>(),
+		                                 [](const std::string& file)
+		                                 {
+			                                 return ends_with(file, ".xyt") || is_minutiae_record(file) ||
+				                                 is_template_file(file);
+		                                 });
+
+		const auto format = template_options.format();
+		const auto max_minutiae = static_cast<u32>(template_options.max_minutiae);
+		TemplatePackWriter writer{};
+		if (!writer.open(output_file, max_minutiae, format))
+		{
+			return 1;
+		}
+
+		// templates are prepared in parallel, but written in the order of the files
+		constexpr std::size_t chunk_size = 1000;
+		std::size_t failed = 0;
+		{
+			ThreadPool pool{static_cast<u32>(template_options.threads)};
+			std::vector<std::future<std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>>> tasks{};
+			tasks.reserve(chunk_size);
+			for (std::size_t first = 0; first < files.size(); first += chunk_size)
+			{
+				const auto last = std::min(first + chunk_size, files.size());
+				for (auto i = first; i < last; i++)
+				{
+					tasks.push_back(pool.enqueue([&, i]()
+					{
+						return prepare_data(files[i], max_minutiae, format);
+					}));
+				}
+				for (auto i = first; i < last; i++)
+				{
+					const auto data = tasks[i - first].get();
+					if (!data.has_value())
+					{
+						failed++;
+					}
+					else if (!writer.add(files[i], data->first, data->second))
+					{
+						std::cerr << "error: cannot write template pack " << output_file << "\n";
+						return 1;
+					}
+				}
+				tasks.clear();
+			}
+		}
+
+		if (!writer.finish())
+		{
+			return 1;
+		}
+
+		std::cerr << "packed " << files.size() - failed << " of " << files.size() << " files\n";
+		return failed == 0 ? 0 : 1;
+	}
+	catch (const cxxopts::exceptions::parsing& e)
+	{
+		std::cout << "error parsing options: " << e.what() << std::endl;
+		exit(1);
+	}
+}
+
+
 int main(int argc, const char* argv[])
 {
+	if (argc > 1 && std::string_view{argv[1]} == "convert")
+	{
+		return convert(argc - 1, argv + 1);
+	}
+
+	if (argc > 1 && std::string_view{argv[1]} == "pack")
+	{
+		return pack(argc - 1, argv + 1);
+	}
+
 	auto result = parse(argc, argv);
 	const auto& arguments = result.arguments();
 	return 0;
@@ -0,0 +1,427 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "utils.h"
+#include "minutiae_record.h"
+#include "result_writer.h"
+#include "score_matrix.h"
+#include "template_cache.h"
+#include "template_file.h"
+#include "template_pack.h"
+
+namespace fs = std::filesystem;
+
+/*
+ * Round trip checks of the file formats written and read by bz3. Every check works on generated
+ * templates in a scratch directory, reports what differs and makes the program exit with 1.
+ */
+
+constexpr u32 MAX_MINUTIAE = 150;
+constexpr int NUMBER_OF_FILES = 20;
+// more than the shards of the template cache, so that shards hold several templates and evict them
+constexpr int NUMBER_OF_CACHED_FILES = 200;
+
+static bool report(bool passed, std::string_view check)
+{
+	std::cout << (passed ? "ok      " : "FAILED  ") << check << "\n";
+	return passed;
+}
+
+// random minutiae in a 500 x 500 image, in the order and columns of .xyt files
+static std::vector<RawMinutia> random_minutiae(std::mt19937& random, int count)
+{
+	std::vector<RawMinutia> minutiae{};
+	for (int i = 0; i < count; i++)
+	{
+		minutiae.push_back(RawMinutia{
+			.x = static_cast<int>(10 + random() % 480),
+			.y = static_cast<int>(10 + random() % 480),
+			.t = static_cast<int>(random() % 360),
+			.q = static_cast<int>(random() % 100),
+		});
+	}
+	return minutiae;
+}
+
+static void write_xyt(const fs::path& path, std::span<const RawMinutia> minutiae)
+{
+	std::ofstream file{path};
+	for (const auto& minutia : minutiae)
+	{
+		file << minutia.x << " " << minutia.y << " " << minutia.t << " " << minutia.q << "\n";
+	}
+}
+
+// .xyt files with 5 to 180 minutiae, so that every capacity of the matcher and pruning are used
+static std::vector<std::string> write_xyt_files(const fs::path& directory, int count)
+{
+	std::mt19937 random{7};
+	std::vector<std::string> files{};
+	for (int i = 0; i < count; i++)
+	{
+		const auto path = directory / ("t" + std::to_string(i) + ".xyt");
+		write_xyt(path, random_minutiae(random, static_cast<int>(5 + random() % 176)));
+		files.push_back(path.string());
+	}
+	return files;
+}
+
+static bool same_minutiae(std::span<const Minutia> a, std::span<const Minutia> b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Minutia& l, const Minutia& r)
+	{
+		return l.x == r.x && l.y == r.y && l.t == r.t && l.kind == r.kind;
+	});
+}
+
+static bool same_edges(EdgesView a, EdgesView b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (std::size_t i = 0; i < a.size(); i++)
+	{
+		const auto l = a[i];
+		const auto r = b[i];
+		if (l.distance_squared != r.distance_squared || l.min_beta != r.min_beta || l.max_beta != r.max_beta ||
+			l.endpoint_k != r.endpoint_k || l.endpoint_j != r.endpoint_j || l.theta_kj != r.theta_kj ||
+			l.beta_order != r.beta_order)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool same_template(std::span<const Minutia> a_minutiae, std::span<const Edge> a_edges,
+                          std::span<const Minutia> b_minutiae, EdgesView b_edges)
+{
+	const Edges a{a_edges};
+	return same_minutiae(a_minutiae, b_minutiae) && same_edges(a.view(), b_edges);
+}
+
+// every .xyt file saved as a .bzt file in both formats loads back unchanged
+static bool check_template_files(const fs::path& directory, std::span<const std::string> files)
+{
+	bool passed = true;
+	for (const auto format : {bz3::Format::NistInternal, bz3::Format::Ansi})
+	{
+		for (const auto& file : files)
+		{
+			const auto prepared = prepare_data(file, MAX_MINUTIAE, format);
+			const auto path = (directory / "template.bzt").string();
+			if (!prepared.has_value() ||
+				!save_template(path, prepared->first, prepared->second, MAX_MINUTIAE, format))
+			{
+				std::cout << "cannot save template of " << file << "\n";
+				passed = false;
+				continue;
+			}
+
+			const auto loaded = load_template(path, MAX_MINUTIAE, format);
+			if (!loaded.has_value() ||
+				!same_template(prepared->first, prepared->second, loaded->first, Edges{loaded->second}.view()))
+			{
+				std::cout << "template of " << file << " differs after loading\n";
+				passed = false;
+			}
+		}
+	}
+
+	// a template is only loaded for the parameters it was prepared for
+	return passed && !load_template((directory / "template.bzt").string(), MAX_MINUTIAE, bz3::Format::NistInternal);
+}
+
+// templates written to a pack in reverse order are found by name with the same minutiae and edges
+static bool check_template_pack(const fs::path& directory, std::span<const std::string> files)
+{
+	const auto path = (directory / "templates.bzp").string();
+	TemplatePackWriter writer{};
+	if (!writer.open(path, MAX_MINUTIAE, bz3::Format::NistInternal))
+	{
+		return false;
+	}
+	for (auto it = files.rbegin(); it != files.rend(); ++it)
+	{
+		const auto prepared = prepare_data(*it, MAX_MINUTIAE);
+		if (!prepared.has_value() || !writer.add(*it, prepared->first, prepared->second))
+		{
+			return false;
+		}
+	}
+	if (!writer.finish())
+	{
+		return false;
+	}
+
+	const auto pack = TemplatePack::open(path, MAX_MINUTIAE, bz3::Format::NistInternal);
+	if (pack == nullptr || pack->size() != files.size())
+	{
+		return false;
+	}
+
+	bool passed = true;
+	for (const auto& file : files)
+	{
+		const auto prepared = prepare_data(file, MAX_MINUTIAE);
+		const auto packed = pack->find(file);
+		if (!packed.has_value() || !same_template(prepared->first, prepared->second, packed->first, packed->second))
+		{
+			std::cout << "template of " << file << " differs in the pack\n";
+			passed = false;
+		}
+	}
+	return passed && !pack->find("missing.xyt").has_value() &&
+		TemplatePack::open(path, MAX_MINUTIAE, bz3::Format::Ansi) == nullptr;
+}
+
+static void append_be16(std::string& bytes, int value)
+{
+	bytes += static_cast<char>(value >> 8);
+	bytes += static_cast<char>(value & 0xFF);
+}
+
+// ANSI INCITS 378 record with one view of minutiae of type other, which have no kind like the ones of .xyt files
+static void write_minutiae_record(const fs::path& path, std::span<const RawMinutia> minutiae, int width, int height)
+{
+	std::string view{};
+	view += static_cast<char>(1);
+	view += static_cast<char>(0);
+	view += static_cast<char>(60);
+	view += static_cast<char>(minutiae.size());
+	for (const auto& minutia : minutiae)
+	{
+		append_be16(view, minutia.x);
+		append_be16(view, minutia.y);
+		view += static_cast<char>(minutia.t / 2);
+		view += static_cast<char>(minutia.q);
+	}
+	append_be16(view, 0);
+
+	std::string record{"FMR\0 20\0", 8};
+	append_be16(record, static_cast<int>(26 + view.size()));
+	append_be16(record, 0);
+	append_be16(record, 0);
+	append_be16(record, 0);
+	append_be16(record, width);
+	append_be16(record, height);
+	append_be16(record, 197);
+	append_be16(record, 197);
+	record += static_cast<char>(1);
+	record += static_cast<char>(0);
+	record += view;
+
+	std::ofstream file{path, std::ios::binary};
+	file << record;
+}
+
+/*
+ * A minutiae record gives the same template as the .xyt file of its minutiae in the coordinates of the format,
+ * and so the same score against another template. NIST internal .xyt files have the origin in the bottom
+ * left corner and directions turned by 180 degrees.
+ */
+static bool check_minutiae_record(const fs::path& directory)
+{
+	constexpr int HEIGHT = 500;
+	std::mt19937 random{11};
+	auto minutiae = random_minutiae(random, 60);
+	for (auto& minutia : minutiae)
+	{
+		minutia.t -= minutia.t % 2;
+	}
+	const auto record = (directory / "record.fmr").string();
+	write_minutiae_record(record, minutiae, 500, HEIGHT);
+
+	bool passed = true;
+	for (const auto format : {bz3::Format::NistInternal, bz3::Format::Ansi})
+	{
+		auto converted = minutiae;
+		if (format == bz3::Format::NistInternal)
+		{
+			for (auto& minutia : converted)
+			{
+				minutia.y = HEIGHT - 1 - minutia.y;
+				minutia.t = (minutia.t + 180) % 360;
+			}
+		}
+		const auto xyt = (directory / "record.xyt").string();
+		write_xyt(xyt, converted);
+
+		// the same finger slightly moved and turned
+		for (auto& minutia : converted)
+		{
+			minutia.x += 6;
+			minutia.y -= 4;
+			minutia.t = (minutia.t + 2) % 360;
+		}
+		const auto moved = (directory / "moved.xyt").string();
+		write_xyt(moved, converted);
+
+		const auto from_record = prepare_data(record, MAX_MINUTIAE, format);
+		const auto from_xyt = prepare_data(xyt, MAX_MINUTIAE, format);
+		const auto gallery = prepare_data(moved, MAX_MINUTIAE, format);
+		if (!from_record.has_value() || !from_xyt.has_value() || !gallery.has_value())
+		{
+			return false;
+		}
+
+		const auto record_score = match(from_record->first, from_record->second, gallery->first, gallery->second, format);
+		const auto xyt_score = match(from_xyt->first, from_xyt->second, gallery->first, gallery->second, format);
+		if (!same_template(from_record->first, from_record->second, from_xyt->first, Edges{from_xyt->second}.view()) ||
+			record_score != xyt_score || record_score == 0)
+		{
+			std::cout << "record scores " << record_score << ", its .xyt file " << xyt_score << "\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+// a cache with a budget of one byte returns the same templates after evicting them as loaded the first time
+static bool check_template_cache(const fs::path& directory)
+{
+	fs::create_directories(directory / "cached");
+	const auto files = write_xyt_files(directory / "cached", NUMBER_OF_CACHED_FILES);
+
+	TemplateCache cache{MAX_MINUTIAE, bz3::Format::NistInternal, 1};
+	const auto ids = cache.intern(files);
+	const auto kept = cache.get(ids.front());
+
+	bool passed = kept.has_value();
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (const auto id : ids)
+		{
+			const auto prepared = prepare_data(cache.name(id), MAX_MINUTIAE);
+			const auto cached = cache.get(id);
+			if (!cached.has_value() || !same_template(prepared->first, prepared->second, cached->minutiae, cached->edges))
+			{
+				std::cout << "cached template of " << cache.name(id) << " differs in pass " << pass << "\n";
+				passed = false;
+			}
+		}
+	}
+
+	// a template in use stays valid after its eviction
+	const auto prepared = prepare_data(files.front(), MAX_MINUTIAE);
+	return passed && same_template(prepared->first, prepared->second, kept->minutiae, kept->edges) &&
+		cache.evictions() > 0 && cache.misses() > ids.size();
+}
+
+static u16 read_le16(const std::string& bytes, u64 offset)
+{
+	return static_cast<u16>(static_cast<u8>(bytes[offset]) | static_cast<u8>(bytes[offset + 1]) << 8);
+}
+
+// a created score matrix has the documented header, the names of the probes and galleries and the set scores
+static bool check_score_matrix(const fs::path& directory)
+{
+	const std::vector<std::string> probes{"p0.xyt", "p1.xyt", "p2.xyt"};
+	const std::vector<std::string> galleries{"g0.xyt", "g1.xyt"};
+	const auto path = (directory / "scores.bzm").string();
+
+	const auto matrix = ScoreMatrix::create(path, probes, galleries);
+	if (matrix == nullptr)
+	{
+		return false;
+	}
+	for (u64 probe = 0; probe < probes.size(); probe++)
+	{
+		for (u64 gallery = 0; gallery < galleries.size(); gallery++)
+		{
+			matrix->set(probe, gallery, static_cast<int>(10 * probe + gallery));
+		}
+	}
+	matrix->set(0, 1, -5);
+	matrix->set(1, 1, 70000);
+	matrix->set(2, 0, std::nullopt);
+	if (!matrix->close())
+	{
+		return false;
+	}
+
+	std::ifstream file{path, std::ios::binary};
+	const std::string bytes{std::istreambuf_iterator<char>{file}, {}};
+	ScoreMatrixHeader header{};
+	if (bytes.size() < sizeof(header))
+	{
+		return false;
+	}
+	std::memcpy(&header, bytes.data(), sizeof(header));
+
+	const std::string names{"p0.xyt\np1.xyt\np2.xyt\ng0.xyt\ng1.xyt\n"};
+	const auto cell = [&](u64 probe, u64 gallery)
+	{
+		return read_le16(bytes, header.cells_offset + 2 * (probe * galleries.size() + gallery));
+	};
+	return std::string_view{header.magic, 4} == std::string_view{"BZM\0", 4} &&
+		header.version == SCORE_MATRIX_VERSION && header.rows == probes.size() &&
+		header.columns == galleries.size() && header.names_size == names.size() &&
+		bytes.compare(header.names_offset, header.names_size, names) == 0 &&
+		header.cells_offset % SCORE_MATRIX_ALIGNMENT == 0 &&
+		header.cells_offset >= header.names_offset + header.names_size &&
+		bytes.size() >= header.cells_offset + 2 * probes.size() * galleries.size() &&
+		cell(1, 0) == 10 && cell(2, 1) == 21 && cell(0, 1) == 0 &&
+		cell(1, 1) == SCORE_MATRIX_MAX_SCORE && cell(2, 0) == SCORE_MATRIX_MISSING;
+}
+
+// results written in blocks of the result writer are the same bytes as written straight to a stream
+static bool check_result_writer()
+{
+	bool passed = true;
+	for (const bool only_score : {false, true})
+	{
+		std::mt19937 random{13};
+		std::ostringstream expected{};
+		std::ostringstream written{};
+		{
+			ResultWriter writer{written};
+			// several blocks of the writer
+			for (int i = 0; i < 100000; i++)
+			{
+				const auto probe = "probes/p" + std::to_string(random() % 1000) + ".xyt";
+				const auto gallery = "galleries/g" + std::to_string(random() % 100000) + ".xyt";
+				const auto score = i % 7 == 0 ? std::nullopt : std::optional<int>{static_cast<int>(random() % 500)};
+				if (!only_score)
+				{
+					expected << probe << " " << gallery << " ";
+				}
+				expected << score.value_or(-1) << "\n";
+				writer.write_result(probe, gallery, score, only_score);
+			}
+		}
+		if (written.str() != expected.str())
+		{
+			std::cout << "results differ, " << written.str().size() << " bytes written instead of "
+				<< expected.str().size() << "\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+int main()
+{
+	const auto directory = fs::temp_directory_path() / "bz3-checks";
+	fs::remove_all(directory);
+	fs::create_directories(directory);
+
+	const auto files = write_xyt_files(directory, NUMBER_OF_FILES);
+
+	bool passed = true;
+	passed = report(check_template_files(directory, files), "template files") && passed;
+	passed = report(check_template_pack(directory, files), "template pack") && passed;
+	passed = report(check_minutiae_record(directory), "minutiae record") && passed;
+	passed = report(check_template_cache(directory), "template cache") && passed;
+	passed = report(check_score_matrix(directory), "score matrix") && passed;
+	passed = report(check_result_writer(), "result writer") && passed;
+
+	fs::remove_all(directory);
+	return passed ? 0 : 1;
+}
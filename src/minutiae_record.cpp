@@ -0,0 +1,294 @@
+#include "minutiae_record.h"
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+constexpr std::array<char, 8> MINUTIAE_RECORD_MAGIC = {'F', 'M', 'R', '\0', ' ', '2', '0', '\0'};
+constexpr std::size_t ANSI_HEADER_SIZE = 26;
+constexpr std::size_t ISO_HEADER_SIZE = 24;
+constexpr std::size_t FINGER_VIEW_HEADER_SIZE = 4;
+constexpr std::size_t MINUTIA_SIZE = 6;
+
+enum RecordMinutiaType : u8
+{
+	OTHER = 0b00,
+	RIDGE_ENDING = 0b01,
+	BIFURCATION = 0b10
+};
+
+// big endian reader; reading past the end yields zeros and marks the reader as failed
+class RecordReader
+{
+private:
+	std::span<const u8> bytes_;
+	std::size_t position_ = 0;
+	bool failed_ = false;
+
+public:
+	explicit RecordReader(std::span<const u8> bytes) : bytes_{bytes}
+	{
+	}
+
+	[[nodiscard]] bool has(std::size_t size) const
+	{
+		return position_ <= bytes_.size() && bytes_.size() - position_ >= size;
+	}
+
+	[[nodiscard]] bool failed() const { return failed_; }
+
+	[[nodiscard]] std::size_t position() const { return position_; }
+
+	void skip(std::size_t size) { position_ += size; }
+
+	u8 u8_value()
+	{
+		if (!has(1))
+		{
+			failed_ = true;
+			return 0;
+		}
+		return bytes_[position_++];
+	}
+
+	u16 u16_value()
+	{
+		if (!has(2))
+		{
+			failed_ = true;
+			return 0;
+		}
+		const auto value = static_cast<u16>(bytes_[position_] << 8 | bytes_[position_ + 1]);
+		position_ += 2;
+		return value;
+	}
+
+	u32 u32_value()
+	{
+		const u32 high = u16_value();
+		return high << 16 | u16_value();
+	}
+};
+
+std::pair<std::string_view, std::optional<u32>> split_finger_view(std::string_view name)
+{
+	const auto separator = name.rfind(FINGER_VIEW_SEPARATOR);
+	if (separator == std::string_view::npos)
+	{
+		return {name, std::nullopt};
+	}
+
+	const auto index = name.substr(separator + 1);
+	u32 value{};
+	const auto [end, error] = std::from_chars(index.data(), index.data() + index.size(), value);
+	if (index.empty() || error != std::errc{} || end != index.data() + index.size())
+	{
+		return {name, std::nullopt};
+	}
+	return {name.substr(0, separator), value};
+}
+
+bool is_minutiae_record(std::string_view name)
+{
+	const auto path = split_finger_view(name).first;
+	return path.size() >= MINUTIAE_RECORD_EXTENSION.size() &&
+		path.substr(path.size() - MINUTIAE_RECORD_EXTENSION.size()) == MINUTIAE_RECORD_EXTENSION;
+}
+
+static std::optional<MinutiaeStandard> detect_standard(std::span<const u8> bytes, std::size_t& header_size)
+{
+	RecordReader reader{bytes};
+	reader.skip(MINUTIAE_RECORD_MAGIC.size());
+
+	// ISO uses 4 bytes for the record length, ANSI 2 bytes or 0 followed by 4 bytes
+	if (RecordReader iso = reader; iso.u32_value() == bytes.size())
+	{
+		header_size = ISO_HEADER_SIZE;
+		return MinutiaeStandard::Iso19794_2;
+	}
+
+	const auto length = reader.u16_value();
+	if (length == bytes.size())
+	{
+		header_size = ANSI_HEADER_SIZE;
+		return MinutiaeStandard::Ansi378;
+	}
+	if (length == 0 && reader.has(4) && reader.u32_value() == bytes.size())
+	{
+		header_size = ANSI_HEADER_SIZE + 4;
+		return MinutiaeStandard::Ansi378;
+	}
+	return std::nullopt;
+}
+
+std::optional<MinutiaeRecord> parse_minutiae_record(std::span<const u8> bytes, std::string_view source)
+{
+	if (bytes.size() < ANSI_HEADER_SIZE ||
+		std::memcmp(bytes.data(), MINUTIAE_RECORD_MAGIC.data(), MINUTIAE_RECORD_MAGIC.size()) != 0)
+	{
+		std::cerr << "error: file " << source << " is not a finger minutiae record\n";
+		return std::nullopt;
+	}
+
+	std::size_t header_size{};
+	const auto standard = detect_standard(bytes, header_size);
+	if (!standard.has_value())
+	{
+		std::cerr << "error: length of finger minutiae record " << source << " does not match its size\n";
+		return std::nullopt;
+	}
+
+	if (bytes.size() < header_size)
+	{
+		std::cerr << "error: finger minutiae record " << source << " is truncated\n";
+		return std::nullopt;
+	}
+
+	MinutiaeRecord record{};
+	record.standard = standard.value();
+
+	// image size, resolution and number of views are the last fields of both headers
+	RecordReader reader{bytes};
+	reader.skip(header_size - 10);
+	record.width = reader.u16_value();
+	record.height = reader.u16_value();
+	reader.skip(4);
+	const auto number_of_views = reader.u8_value();
+	reader.skip(1);
+
+	record.views.reserve(number_of_views);
+	for (u32 i = 0; i < number_of_views; i++)
+	{
+		if (!reader.has(FINGER_VIEW_HEADER_SIZE))
+		{
+			std::cerr << "error: finger minutiae record " << source << " is truncated\n";
+			return std::nullopt;
+		}
+
+		FingerView view{};
+		view.finger_position = reader.u8_value();
+		const auto view_and_impression = reader.u8_value();
+		view.view_number = static_cast<u8>(view_and_impression >> 4);
+		view.impression_type = static_cast<u8>(view_and_impression & 0x0F);
+		view.quality = reader.u8_value();
+		const auto number_of_minutiae = reader.u8_value();
+
+		if (!reader.has(number_of_minutiae * MINUTIA_SIZE + 2))
+		{
+			std::cerr << "error: finger minutiae record " << source << " is truncated\n";
+			return std::nullopt;
+		}
+
+		view.minutiae.reserve(number_of_minutiae);
+		for (u32 j = 0; j < number_of_minutiae; j++)
+		{
+			const auto type_and_x = reader.u16_value();
+			const auto y = reader.u16_value();
+			const auto angle = reader.u8_value();
+			const auto quality = reader.u8_value();
+
+			// ANSI stores angles in units of 2 degrees, ISO in units of 360/256 degrees
+			const int t = record.standard == MinutiaeStandard::Ansi378
+				              ? angle * 2
+				              : (angle * 360 + 128) / 256 % 360;
+			const auto type = static_cast<u8>(type_and_x >> 14);
+			view.minutiae.push_back(RawMinutia{
+				.x = type_and_x & 0x3FFF,
+				.y = y & 0x3FFF,
+				.t = t,
+				.q = quality,
+				.kind = type == BIFURCATION
+					        ? MinutiaKind::Bif
+					        : type == RIDGE_ENDING
+					        ? MinutiaKind::Rig
+					        : MinutiaKind::Unknown,
+			});
+		}
+
+		const auto extended_data_length = reader.u16_value();
+		if (!reader.has(extended_data_length))
+		{
+			std::cerr << "error: finger minutiae record " << source << " is truncated\n";
+			return std::nullopt;
+		}
+		reader.skip(extended_data_length);
+
+		record.views.push_back(std::move(view));
+	}
+
+	if (reader.failed())
+	{
+		std::cerr << "error: finger minutiae record " << source << " is truncated\n";
+		return std::nullopt;
+	}
+	return record;
+}
+
+std::optional<MinutiaeRecord> load_minutiae_record(std::string_view path)
+{
+	std::ifstream file{std::string{path}, std::ios::in | std::ios::binary | std::ios::ate};
+	if (file.fail())
+	{
+		std::cerr << "error: cannot load finger minutiae record from file " << path << "\n";
+		return std::nullopt;
+	}
+
+	std::vector<u8> bytes(static_cast<std::size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+	if (file.fail())
+	{
+		std::cerr << "error: cannot load finger minutiae record from file " << path << "\n";
+		return std::nullopt;
+	}
+
+	return parse_minutiae_record(bytes, path);
+}
+
+std::vector<std::string> list_finger_views(const std::string& path)
+{
+	const auto record = load_minutiae_record(path);
+	if (!record.has_value() || record->views.size() <= 1)
+	{
+		return {path};
+	}
+
+	std::vector<std::string> names{};
+	names.reserve(record->views.size());
+	for (std::size_t i = 0; i < record->views.size(); i++)
+	{
+		names.push_back(path + FINGER_VIEW_SEPARATOR + std::to_string(i));
+	}
+	return names;
+}
+
+std::optional<std::vector<RawMinutia>> load_record_minutiae(std::string_view name, bz3::Format format)
+{
+	const auto [path, view_index] = split_finger_view(name);
+	auto record = load_minutiae_record(path);
+	if (!record.has_value())
+	{
+		return std::nullopt;
+	}
+
+	const auto index = view_index.value_or(0);
+	if (index >= record->views.size())
+	{
+		std::cerr << "error: finger minutiae record " << path << " has no finger view " << index << "\n";
+		return std::nullopt;
+	}
+
+	// NIST internal coordinates have the origin in the bottom left corner and directions turned by 180 degrees
+	auto& minutiae = record->views[index].minutiae;
+	if (format == bz3::Format::NistInternal)
+	{
+		for (auto& minutia : minutiae)
+		{
+			minutia.y = record->height - 1 - minutia.y;
+			minutia.t = (minutia.t + 180) % 360;
+		}
+	}
+
+	return std::move(minutiae);
+}
@@ -0,0 +1,62 @@
+#ifndef BZ_MINUTIAE_RECORD_H
+#define BZ_MINUTIAE_RECORD_H
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "utils.h"
+
+/*
+ * Binary finger minutiae records (.fmr) according to ANSI INCITS 378-2004 or ISO/IEC 19794-2:2005,
+ * told apart by the length of the record length field. A record holds one or more finger views;
+ * "record.fmr#N" names the view with index N (counted from 0) and "record.fmr" the first one.
+ */
+constexpr std::string_view MINUTIAE_RECORD_EXTENSION = ".fmr";
+constexpr char FINGER_VIEW_SEPARATOR = '#';
+
+enum class MinutiaeStandard
+{
+	Ansi378,
+	Iso19794_2
+};
+
+struct FingerView
+{
+	u8 finger_position{};
+	u8 view_number{};
+	u8 impression_type{};
+	u8 quality{};
+	// coordinates as stored in the record (origin in the top left corner), angles in degrees
+	std::vector<RawMinutia> minutiae{};
+};
+
+struct MinutiaeRecord
+{
+	MinutiaeStandard standard{};
+	u16 width{};
+	u16 height{};
+	std::vector<FingerView> views{};
+};
+
+// splits "record.fmr#N" into the path of the record and the index of the view
+std::pair<std::string_view, std::optional<u32>> split_finger_view(std::string_view name);
+
+bool is_minutiae_record(std::string_view name);
+
+std::optional<MinutiaeRecord> parse_minutiae_record(std::span<const u8> bytes, std::string_view source);
+
+std::optional<MinutiaeRecord> load_minutiae_record(std::string_view path);
+
+// names of all finger views of the record: the path itself when it has a single view
+std::vector<std::string> list_finger_views(const std::string& path);
+
+/*
+ * Minutiae of the named finger view, still to be pruned like the ones of .xyt files. Coordinates are
+ * converted to the convention of the format, so the edges are found the same way as for .xyt files.
+ */
+std::optional<std::vector<RawMinutia>> load_record_minutiae(std::string_view name, bz3::Format format);
+
+#endif //BZ_MINUTIAE_RECORD_H
@@ -0,0 +1,72 @@
+#include "result_writer.h"
+
+ResultWriter::ResultWriter(std::ostream& output) : output_{output}
+{
+	block_.data = std::make_unique<char[]>(BLOCK_SIZE);
+	thread_ = std::thread{&ResultWriter::write_blocks, this};
+}
+
+ResultWriter::~ResultWriter()
+{
+	submit(true);
+	{
+		std::lock_guard guard{mutex_};
+		should_stop_ = true;
+	}
+	block_pending_.notify_one();
+	thread_.join();
+}
+
+void ResultWriter::submit(bool flush)
+{
+	block_.flush = flush;
+	std::unique_lock lock{mutex_};
+	block_written_.wait(lock, [this]()
+	{
+		return pending_.size() < MAX_PENDING_BLOCKS;
+	});
+
+	pending_.push_back(std::move(block_));
+	if (free_.empty())
+	{
+		block_ = Block{.data = std::make_unique<char[]>(BLOCK_SIZE)};
+	}
+	else
+	{
+		block_ = std::move(free_.back());
+		free_.pop_back();
+	}
+	lock.unlock();
+	block_pending_.notify_one();
+}
+
+void ResultWriter::write_blocks()
+{
+	std::unique_lock lock{mutex_};
+	for (;;)
+	{
+		block_pending_.wait(lock, [this]()
+		{
+			return should_stop_ || !pending_.empty();
+		});
+		if (pending_.empty())
+		{
+			return;
+		}
+
+		auto block = std::move(pending_.front());
+		pending_.pop_front();
+		lock.unlock();
+
+		output_.write(block.data.get(), static_cast<std::streamsize>(block.size));
+		if (block.flush)
+		{
+			output_.flush();
+		}
+
+		lock.lock();
+		block.size = 0;
+		free_.push_back(std::move(block));
+		block_written_.notify_one();
+	}
+}
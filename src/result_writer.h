@@ -0,0 +1,110 @@
+#ifndef BZ_RESULT_WRITER_H
+#define BZ_RESULT_WRITER_H
+
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * Formats results into large blocks on the thread reporting them and writes the filled blocks to the
+ * output on a thread of its own, in the order in which they were filled. Only one thread may report
+ * results at a time. The output is flushed only by flush() and when the writer is destroyed.
+ */
+class ResultWriter
+{
+private:
+	static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+	// blocks waiting for the output at most, before reporting has to wait as well
+	static constexpr std::size_t MAX_PENDING_BLOCKS = 8;
+
+	struct Block
+	{
+		std::unique_ptr<char[]> data{};
+		std::size_t size = 0;
+		bool flush = false;
+	};
+
+	std::ostream& output_;
+	Block block_{};
+	std::deque<Block> pending_{};
+	std::vector<Block> free_{};
+	std::mutex mutex_{};
+	std::condition_variable block_pending_{};
+	std::condition_variable block_written_{};
+	bool should_stop_ = false;
+	std::thread thread_{};
+
+	void submit(bool flush);
+
+	void write_blocks();
+
+public:
+	explicit ResultWriter(std::ostream& output);
+
+	ResultWriter(const ResultWriter&) = delete;
+
+	ResultWriter& operator=(const ResultWriter&) = delete;
+
+	~ResultWriter();
+
+	void write(std::string_view text)
+	{
+		while (block_.size + text.size() > BLOCK_SIZE)
+		{
+			const auto length = BLOCK_SIZE - block_.size;
+			std::memcpy(block_.data.get() + block_.size, text.data(), length);
+			block_.size += length;
+			text.remove_prefix(length);
+			submit(false);
+		}
+		std::memcpy(block_.data.get() + block_.size, text.data(), text.size());
+		block_.size += text.size();
+	}
+
+	void write(char value)
+	{
+		if (block_.size == BLOCK_SIZE)
+		{
+			submit(false);
+		}
+		block_.data[block_.size++] = value;
+	}
+
+	void write(int value)
+	{
+		if (BLOCK_SIZE - block_.size < 16)
+		{
+			submit(false);
+		}
+		const auto [end, error] = std::to_chars(block_.data.get() + block_.size, block_.data.get() + BLOCK_SIZE,
+		                                        value);
+		block_.size = static_cast<std::size_t>(end - block_.data.get());
+	}
+
+	// line of a comparison as "probe gallery score", or only its score; a failed comparison scores -1
+	void write_result(std::string_view probe, std::string_view gallery, std::optional<int> score, bool only_score)
+	{
+		if (!only_score)
+		{
+			write(probe);
+			write(' ');
+			write(gallery);
+			write(' ');
+		}
+		write(score.value_or(-1));
+		write('\n');
+	}
+
+	// hands over everything written so far and flushes the output once it is written
+	void flush() { submit(true); }
+};
+
+#endif //BZ_RESULT_WRITER_H
@@ -0,0 +1,177 @@
+#include "score_matrix.h"
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+constexpr std::array<char, 4> SCORE_MATRIX_MAGIC = {'B', 'Z', 'M', '\0'};
+
+#ifdef _WIN32
+
+bool ScoreMatrix::map(std::size_t size)
+{
+	file_ = CreateFileA(path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+	                    FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE)
+	{
+		file_ = nullptr;
+		return false;
+	}
+
+	// the mapping extends the file to its full size
+	const auto high = static_cast<DWORD>(static_cast<u64>(size) >> 32);
+	const auto low = static_cast<DWORD>(size & 0xFFFFFFFF);
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, high, low, nullptr);
+	if (mapping_ == nullptr)
+	{
+		return false;
+	}
+
+	data_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0));
+	size_ = data_ != nullptr ? size : 0;
+	return data_ != nullptr;
+}
+
+bool ScoreMatrix::unmap()
+{
+	bool is_written = true;
+	if (data_ != nullptr)
+	{
+		is_written = FlushViewOfFile(data_, 0) && is_written;
+		is_written = UnmapViewOfFile(data_) && is_written;
+		data_ = nullptr;
+	}
+	if (mapping_ != nullptr)
+	{
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+	}
+	if (file_ != nullptr)
+	{
+		// the flushed view is only in the file cache until the file buffers are flushed as well
+		is_written = FlushFileBuffers(file_) && is_written;
+		is_written = CloseHandle(file_) && is_written;
+		file_ = nullptr;
+	}
+	return is_written;
+}
+
+#else
+
+bool ScoreMatrix::map(std::size_t size)
+{
+	file_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file_ == -1)
+	{
+		return false;
+	}
+
+	// allocating the blocks now makes a full disk fail here instead of with SIGBUS while writing scores
+#ifdef __linux__
+	if (posix_fallocate(file_, 0, static_cast<off_t>(size)) != 0)
+#else
+	if (ftruncate(file_, static_cast<off_t>(size)) != 0)
+#endif
+	{
+		return false;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data_ = static_cast<char*>(data);
+	size_ = size;
+	return true;
+}
+
+bool ScoreMatrix::unmap()
+{
+	bool is_written = true;
+	if (data_ != nullptr)
+	{
+		is_written = msync(data_, size_, MS_SYNC) == 0 && is_written;
+		is_written = munmap(data_, size_) == 0 && is_written;
+		data_ = nullptr;
+	}
+	if (file_ != -1)
+	{
+		is_written = ::close(file_) == 0 && is_written;
+		file_ = -1;
+	}
+	return is_written;
+}
+
+#endif
+
+ScoreMatrix::~ScoreMatrix()
+{
+	unmap();
+}
+
+std::unique_ptr<ScoreMatrix> ScoreMatrix::create(const std::string& path, std::span<const std::string> probes,
+                                                 std::span<const std::string> galleries)
+{
+	u64 names_size = 0;
+	for (const auto& names : {probes, galleries})
+	{
+		for (const auto& name : names)
+		{
+			names_size += name.size() + 1;
+		}
+	}
+
+	ScoreMatrixHeader header{};
+	std::memcpy(header.magic, SCORE_MATRIX_MAGIC.data(), SCORE_MATRIX_MAGIC.size());
+	header.version = SCORE_MATRIX_VERSION;
+	header.rows = probes.size();
+	header.columns = galleries.size();
+	header.names_offset = sizeof(header);
+	header.names_size = names_size;
+	header.cells_offset = (header.names_offset + names_size + SCORE_MATRIX_ALIGNMENT - 1) /
+		SCORE_MATRIX_ALIGNMENT * SCORE_MATRIX_ALIGNMENT;
+	const auto size = header.cells_offset + header.rows * header.columns * sizeof(u16);
+
+	auto matrix = std::make_unique<ScoreMatrix>();
+	matrix->path_ = path;
+	if (!matrix->map(static_cast<std::size_t>(size)))
+	{
+		std::cerr << "error: cannot create score matrix " << path << " of " << size << " bytes\n";
+		return nullptr;
+	}
+
+	std::memcpy(matrix->data_, &header, sizeof(header));
+	auto* names_data = matrix->data_ + header.names_offset;
+	for (const auto& names : {probes, galleries})
+	{
+		for (const auto& name : names)
+		{
+			std::memcpy(names_data, name.data(), name.size());
+			names_data += name.size();
+			*names_data++ = '\n';
+		}
+	}
+
+	matrix->cells_ = reinterpret_cast<u16*>(matrix->data_ + header.cells_offset);
+	matrix->columns_ = header.columns;
+	return matrix;
+}
+
+bool ScoreMatrix::close()
+{
+	if (!unmap())
+	{
+		std::cerr << "error: cannot write score matrix " << path_ << "\n";
+		return false;
+	}
+	return true;
+}
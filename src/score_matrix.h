@@ -0,0 +1,84 @@
+#ifndef BZ_SCORE_MATRIX_H
+#define BZ_SCORE_MATRIX_H
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include "bozorth3/bozorth3.h"
+
+/*
+ * Binary matrix with the scores of all probes against all galleries:
+ *
+ *   ScoreMatrixHeader
+ *   names: names of the probes (rows) followed by names of the galleries (columns), each ended by '\n'
+ *   cells: u16 score for every probe and gallery, row by row, aligned to SCORE_MATRIX_ALIGNMENT
+ *
+ * The file is allocated in full when it is created and memory mapped, so any thread can write any
+ * cell at any time. Scores above SCORE_MATRIX_MAX_SCORE are clamped to it, comparisons which failed
+ * are stored as SCORE_MATRIX_MISSING. All values are little endian.
+ */
+constexpr u32 SCORE_MATRIX_VERSION = 1;
+constexpr u64 SCORE_MATRIX_ALIGNMENT = 64;
+constexpr u16 SCORE_MATRIX_MAX_SCORE = 0xFFFE;
+constexpr u16 SCORE_MATRIX_MISSING = 0xFFFF;
+
+struct ScoreMatrixHeader
+{
+	char magic[4];
+	u32 version;
+	u64 rows;
+	u64 columns;
+	u64 names_offset;
+	u64 names_size;
+	u64 cells_offset;
+	u64 reserved[2];
+};
+
+static_assert(sizeof(ScoreMatrixHeader) == SCORE_MATRIX_ALIGNMENT);
+
+class ScoreMatrix
+{
+private:
+	std::string path_{};
+	char* data_ = nullptr;
+	std::size_t size_ = 0;
+	u16* cells_ = nullptr;
+	u64 columns_ = 0;
+#ifdef _WIN32
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+
+	bool map(std::size_t size);
+
+	bool unmap();
+
+public:
+	ScoreMatrix() = default;
+
+	ScoreMatrix(const ScoreMatrix&) = delete;
+
+	ScoreMatrix& operator=(const ScoreMatrix&) = delete;
+
+	~ScoreMatrix();
+
+	static std::unique_ptr<ScoreMatrix> create(const std::string& path, std::span<const std::string> probes,
+	                                           std::span<const std::string> galleries);
+
+	void set(u64 probe, u64 gallery, std::optional<int> score)
+	{
+		cells_[probe * columns_ + gallery] = score.has_value()
+			                                     ? static_cast<u16>(std::clamp<int>(
+				                                     score.value(), 0, SCORE_MATRIX_MAX_SCORE))
+			                                     : SCORE_MATRIX_MISSING;
+	}
+
+	// writes the scores through to the disk and unmaps the file; false when they could not be written
+	bool close();
+};
+
+#endif //BZ_SCORE_MATRIX_H
@@ -0,0 +1,139 @@
+#include "template_cache.h"
+#include "utils.h"
+#include <algorithm>
+
+TemplateCache::TemplateCache(u32 max_minutiae, bz3::Format format, std::size_t budget)
+	: max_minutiae_{max_minutiae},
+	  format_{format},
+	  shard_budget_{budget == UNLIMITED ? UNLIMITED : std::max<std::size_t>(budget / SHARDS, 1)}
+{
+}
+
+u32 TemplateCache::intern(const std::string& name)
+{
+	if (const auto it = ids_.find(name); it != ids_.end())
+	{
+		return it->second;
+	}
+
+	const auto id = static_cast<u32>(names_.size());
+	const auto& interned = names_.emplace_back(name);
+	ids_.emplace(interned, id);
+	slots_.emplace_back().packed = find_packed_data(interned);
+	return id;
+}
+
+std::vector<u32> TemplateCache::intern(std::span<const std::string> names)
+{
+	std::vector<u32> ids{};
+	ids.reserve(names.size());
+	for (const auto& name : names)
+	{
+		ids.push_back(intern(name));
+	}
+	return ids;
+}
+
+std::optional<u32> TemplateCache::find(std::string_view name) const
+{
+	if (const auto it = ids_.find(name); it != ids_.end())
+	{
+		return it->second;
+	}
+	return std::nullopt;
+}
+
+static TemplateRef make_ref(std::shared_ptr<const TemplateData> data)
+{
+	return TemplateRef{.minutiae = data->minutiae, .edges = data->edges.view(), .owner = std::move(data)};
+}
+
+std::optional<TemplateRef> TemplateCache::get(u32 id)
+{
+	auto& slot = slots_[id];
+	if (slot.packed.has_value())
+	{
+		hits_.fetch_add(1, std::memory_order_relaxed);
+		return TemplateRef{.minutiae = slot.packed->first, .edges = slot.packed->second};
+	}
+
+	auto& shard = shards_[id % SHARDS];
+	{
+		std::lock_guard guard{shard.mutex};
+		if (slot.failed)
+		{
+			return std::nullopt;
+		}
+		if (slot.data != nullptr)
+		{
+			slot.referenced = true;
+			hits_.fetch_add(1, std::memory_order_relaxed);
+			return make_ref(slot.data);
+		}
+	}
+
+	// loaded without the lock, so that the other templates of the shard stay available meanwhile;
+	// two threads missing the same template at once both load it and the first one is kept
+	misses_.fetch_add(1, std::memory_order_relaxed);
+	auto value = prepare_data(names_[id], max_minutiae_, format_);
+	std::shared_ptr<const TemplateData> loaded{};
+	if (value.has_value())
+	{
+		value->first.shrink_to_fit();
+		loaded = std::make_shared<const TemplateData>(TemplateData{
+			.minutiae = std::move(value->first),
+			.edges = Edges{value->second},
+		});
+	}
+
+	std::lock_guard guard{shard.mutex};
+	if (slot.data == nullptr && !slot.failed)
+	{
+		if (loaded == nullptr)
+		{
+			slot.failed = true;
+			return std::nullopt;
+		}
+
+		slot.data = std::move(loaded);
+		slot.bytes = sizeof(TemplateData) + slot.data->minutiae.capacity() * sizeof(Minutia) +
+			slot.data->edges.capacity_bytes();
+		slot.referenced = true;
+		shard.bytes += slot.bytes;
+		shard.resident.push_back(id);
+
+		auto data = slot.data;
+		evict(shard);
+		return make_ref(std::move(data));
+	}
+
+	if (slot.failed)
+	{
+		return std::nullopt;
+	}
+	slot.referenced = true;
+	return make_ref(slot.data);
+}
+
+// CLOCK: the hand clears the referenced flags and evicts the first template found without one
+void TemplateCache::evict(Shard& shard)
+{
+	while (shard.bytes > shard_budget_ && shard.resident.size() > 1)
+	{
+		shard.hand %= shard.resident.size();
+		auto& slot = slots_[shard.resident[shard.hand]];
+		if (slot.referenced)
+		{
+			slot.referenced = false;
+			shard.hand++;
+			continue;
+		}
+
+		shard.bytes -= slot.bytes;
+		slot.data.reset();
+		slot.bytes = 0;
+		shard.resident[shard.hand] = shard.resident.back();
+		shard.resident.pop_back();
+		evictions_.fetch_add(1, std::memory_order_relaxed);
+	}
+}
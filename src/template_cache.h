@@ -0,0 +1,104 @@
+#ifndef BZ_TEMPLATE_CACHE_H
+#define BZ_TEMPLATE_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bozorth3/bozorth3.h"
+
+// loaded template with its edges converted once into the layout of the matcher
+struct TemplateData
+{
+	std::vector<Minutia> minutiae{};
+	Edges edges{};
+};
+
+// prepared template; owner keeps a loaded template alive while it is used, even when it gets evicted
+struct TemplateRef
+{
+	std::span<const Minutia> minutiae{};
+	EdgesView edges{};
+	std::shared_ptr<const TemplateData> owner{};
+};
+
+/*
+ * Thread-safe cache of prepared templates. Names are interned into dense ids before matching starts,
+ * then any thread can get a template by its id and loads it on a miss. Templates of the used packs
+ * are returned from their mappings and never counted. With a byte budget, each shard evicts templates
+ * not used since the last sweep of its clock hand.
+ */
+class TemplateCache
+{
+private:
+	static constexpr std::size_t SHARDS = 64;
+
+	struct Slot
+	{
+		std::shared_ptr<const TemplateData> data{};
+		std::optional<std::pair<std::span<const Minutia>, EdgesView>> packed{};
+		std::size_t bytes = 0;
+		bool failed = false;
+		bool referenced = false;
+	};
+
+	// guards the slots of the ids which fall into the shard
+	struct Shard
+	{
+		std::mutex mutex{};
+		std::vector<u32> resident{};
+		std::size_t hand = 0;
+		std::size_t bytes = 0;
+	};
+
+	u32 max_minutiae_;
+	bz3::Format format_;
+	std::size_t shard_budget_;
+	std::deque<std::string> names_{};
+	std::unordered_map<std::string_view, u32> ids_{};
+	std::vector<Slot> slots_{};
+	std::array<Shard, SHARDS> shards_{};
+	std::atomic<u64> hits_{0};
+	std::atomic<u64> misses_{0};
+	std::atomic<u64> evictions_{0};
+
+	void evict(Shard& shard);
+
+public:
+	static constexpr std::size_t UNLIMITED = std::numeric_limits<std::size_t>::max();
+
+	TemplateCache(u32 max_minutiae, bz3::Format format, std::size_t budget = UNLIMITED);
+
+	// interning is not thread-safe, all names have to be interned before templates are requested
+	u32 intern(const std::string& name);
+
+	std::vector<u32> intern(std::span<const std::string> names);
+
+	[[nodiscard]] std::size_t size() const { return names_.size(); }
+
+	[[nodiscard]] const std::string& name(u32 id) const { return names_[id]; }
+
+	// id of an already interned name
+	[[nodiscard]] std::optional<u32> find(std::string_view name) const;
+
+	[[nodiscard]] bool is_limited() const { return shard_budget_ != UNLIMITED; }
+
+	std::optional<TemplateRef> get(u32 id);
+
+	[[nodiscard]] u64 hits() const { return hits_.load(std::memory_order_relaxed); }
+
+	[[nodiscard]] u64 misses() const { return misses_.load(std::memory_order_relaxed); }
+
+	[[nodiscard]] u64 evictions() const { return evictions_.load(std::memory_order_relaxed); }
+};
+
+#endif //BZ_TEMPLATE_CACHE_H
@@ -0,0 +1,161 @@
+#include "template_file.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+static_assert(std::endian::native == std::endian::little, "template files store the little endian layout");
+static_assert(std::is_trivially_copyable_v<Minutia> && std::is_trivially_copyable_v<Edge>);
+
+constexpr std::array<char, 4> TEMPLATE_FILE_MAGIC = {'B', 'Z', 'T', '\0'};
+
+bool is_template_file(std::string_view path)
+{
+	return path.size() >= TEMPLATE_FILE_EXTENSION.size() &&
+		path.substr(path.size() - TEMPLATE_FILE_EXTENSION.size()) == TEMPLATE_FILE_EXTENSION;
+}
+
+template <typename T, typename Field>
+static void put_field(std::array<char, sizeof(T)>& record, std::size_t offset, Field value)
+{
+	std::memcpy(record.data() + offset, &value, sizeof(Field));
+}
+
+// copies the fields one by one, so that the padding bytes of the record stay zero
+static std::array<char, sizeof(Minutia)> to_record(const Minutia& minutia)
+{
+	std::array<char, sizeof(Minutia)> record{};
+	put_field<Minutia>(record, offsetof(Minutia, x), minutia.x);
+	put_field<Minutia>(record, offsetof(Minutia, y), minutia.y);
+	put_field<Minutia>(record, offsetof(Minutia, t), minutia.t);
+	put_field<Minutia>(record, offsetof(Minutia, kind), minutia.kind);
+	return record;
+}
+
+static std::array<char, sizeof(Edge)> to_record(const Edge& edge)
+{
+	std::array<char, sizeof(Edge)> record{};
+	put_field<Edge>(record, offsetof(Edge, distance_squared), edge.distance_squared);
+	put_field<Edge>(record, offsetof(Edge, min_beta), edge.min_beta);
+	put_field<Edge>(record, offsetof(Edge, max_beta), edge.max_beta);
+	put_field<Edge>(record, offsetof(Edge, endpoint_k), edge.endpoint_k);
+	put_field<Edge>(record, offsetof(Edge, endpoint_j), edge.endpoint_j);
+	put_field<Edge>(record, offsetof(Edge, theta_kj), edge.theta_kj);
+	put_field<Edge>(record, offsetof(Edge, beta_order), edge.beta_order);
+	return record;
+}
+
+void write_template_records(std::ostream& file, std::span<const Minutia> minutiae, std::span<const Edge> edges)
+{
+	for (const auto& minutia : minutiae)
+	{
+		const auto record = to_record(minutia);
+		file.write(record.data(), static_cast<std::streamsize>(record.size()));
+	}
+	for (const auto& edge : edges)
+	{
+		const auto record = to_record(edge);
+		file.write(record.data(), static_cast<std::streamsize>(record.size()));
+	}
+}
+
+bool save_template(const std::string& path, std::span<const Minutia> minutiae, std::span<const Edge> edges,
+                   u32 max_minutiae, bz3::Format format)
+{
+	std::ofstream file{path, std::ios::out | std::ios::binary | std::ios::trunc};
+	if (!file.is_open())
+	{
+		std::cerr << "error: cannot open file " << path << " for writing\n";
+		return false;
+	}
+
+	TemplateFileHeader header{};
+	std::memcpy(header.magic, TEMPLATE_FILE_MAGIC.data(), TEMPLATE_FILE_MAGIC.size());
+	header.version = TEMPLATE_FILE_VERSION;
+	header.max_minutiae = max_minutiae;
+	header.format = static_cast<u32>(format);
+	header.number_of_minutiae = static_cast<u32>(minutiae.size());
+	header.number_of_edges = static_cast<u32>(edges.size());
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	write_template_records(file, minutiae, edges);
+
+	if (!file.good())
+	{
+		std::cerr << "error: cannot write template to file " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+static bool is_valid(std::span<const Minutia> minutiae, std::span<const Edge> edges)
+{
+	for (const auto& edge : edges)
+	{
+		if (edge.endpoint_k >= minutiae.size() || edge.endpoint_j >= minutiae.size() ||
+			(edge.beta_order != KJ && edge.beta_order != JK))
+		{
+			return false;
+		}
+	}
+	return std::all_of(minutiae.begin(), minutiae.end(), [](const Minutia& minutia)
+	{
+		return minutia.kind == MinutiaKind::Unknown || minutia.kind == MinutiaKind::Bif ||
+			minutia.kind == MinutiaKind::Rig;
+	});
+}
+
+std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
+load_template(const std::string& path, u32 max_minutiae, bz3::Format format)
+{
+	std::ifstream file{path, std::ios::in | std::ios::binary};
+	if (file.fail())
+	{
+		std::cerr << "error: cannot load template from file " << path << "\n";
+		return std::nullopt;
+	}
+
+	TemplateFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file.good() || std::memcmp(header.magic, TEMPLATE_FILE_MAGIC.data(), TEMPLATE_FILE_MAGIC.size()) != 0)
+	{
+		std::cerr << "error: file " << path << " is not a template file\n";
+		return std::nullopt;
+	}
+
+	if (header.version != TEMPLATE_FILE_VERSION)
+	{
+		std::cerr << "error: template file " << path << " has unsupported version " << header.version << "\n";
+		return std::nullopt;
+	}
+
+	if (header.max_minutiae != max_minutiae || header.format != static_cast<u32>(format))
+	{
+		std::cerr << "error: template file " << path << " was prepared for " << header.max_minutiae
+			<< " minutiae in " << (header.format == static_cast<u32>(bz3::Format::Ansi) ? "ANSI" : "NIST")
+			<< " format\n";
+		return std::nullopt;
+	}
+
+	if (header.number_of_minutiae > MAX_BOZORTH_MINUTIAE || header.number_of_edges > MAX_NUMBER_OF_EDGES)
+	{
+		std::cerr << "error: template file " << path << " is corrupted\n";
+		return std::nullopt;
+	}
+
+	std::vector<Minutia> minutiae(header.number_of_minutiae);
+	std::vector<Edge> edges(header.number_of_edges);
+	file.read(reinterpret_cast<char*>(minutiae.data()),
+	          static_cast<std::streamsize>(minutiae.size() * sizeof(Minutia)));
+	file.read(reinterpret_cast<char*>(edges.data()), static_cast<std::streamsize>(edges.size() * sizeof(Edge)));
+	if (!file.good() || !is_valid(minutiae, edges))
+	{
+		std::cerr << "error: template file " << path << " is corrupted\n";
+		return std::nullopt;
+	}
+
+	return std::make_pair(std::move(minutiae), std::move(edges));
+}
@@ -0,0 +1,45 @@
+#ifndef BZ_TEMPLATE_FILE_H
+#define BZ_TEMPLATE_FILE_H
+
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "bozorth3/bozorth3.h"
+
+/*
+ * Binary template file (.bzt) with the minutiae and edges of one template exactly as prepare_data
+ * produces them: pruned to max_minutiae, sorted and limited for the given format. It starts with
+ * a TemplateFileHeader followed by the minutiae and the edges in their in-memory layout (little
+ * endian, padding bytes zeroed), so loading is a plain copy.
+ */
+constexpr std::string_view TEMPLATE_FILE_EXTENSION = ".bzt";
+constexpr u32 TEMPLATE_FILE_VERSION = 1;
+
+struct TemplateFileHeader
+{
+	char magic[4];
+	u32 version;
+	u32 max_minutiae;
+	u32 format;
+	u32 number_of_minutiae;
+	u32 number_of_edges;
+};
+
+static_assert(sizeof(TemplateFileHeader) == 24);
+
+bool is_template_file(std::string_view path);
+
+// writes the minutiae followed by the edges in the layout of a template file
+void write_template_records(std::ostream& file, std::span<const Minutia> minutiae, std::span<const Edge> edges);
+
+bool save_template(const std::string& path, std::span<const Minutia> minutiae, std::span<const Edge> edges,
+                   u32 max_minutiae, bz3::Format format);
+
+std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
+load_template(const std::string& path, u32 max_minutiae, bz3::Format format);
+
+#endif //BZ_TEMPLATE_FILE_H
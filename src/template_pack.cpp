@@ -0,0 +1,376 @@
+#include "template_pack.h"
+#include "template_file.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr std::array<char, 4> TEMPLATE_PACK_MAGIC = {'B', 'Z', 'P', '\0'};
+
+// bytes of the edge arrays of a template, with their padding
+static u64 edges_size(u64 number_of_edges)
+{
+	return (number_of_edges + EdgesView::EDGE_LANES) *
+		(4 * sizeof(u16) + 2 * sizeof(u8) + sizeof(OrderKJ));
+}
+
+template <typename T>
+static const T* next_array(const char*& data, std::size_t size)
+{
+	const auto* array = reinterpret_cast<const T*>(data);
+	data += (size + EdgesView::EDGE_LANES) * sizeof(T);
+	return array;
+}
+
+template <typename T>
+static void write_array(std::ostream& file, const T* array, std::size_t size)
+{
+	file.write(reinterpret_cast<const char*>(array),
+	           static_cast<std::streamsize>((size + EdgesView::EDGE_LANES) * sizeof(T)));
+}
+
+bool is_template_pack(std::string_view path)
+{
+	return path.size() >= TEMPLATE_PACK_EXTENSION.size() &&
+		path.substr(path.size() - TEMPLATE_PACK_EXTENSION.size()) == TEMPLATE_PACK_EXTENSION;
+}
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile()
+{
+	if (data_ != nullptr)
+	{
+		UnmapViewOfFile(data_);
+	}
+	if (mapping_ != nullptr)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != nullptr && file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+	}
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                    FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+	{
+		return false;
+	}
+
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_ == nullptr)
+	{
+		return false;
+	}
+
+	data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+	size_ = data_ != nullptr ? static_cast<std::size_t>(size.QuadPart) : 0;
+	return data_ != nullptr;
+}
+
+#else
+
+MappedFile::~MappedFile()
+{
+	if (data_ != nullptr)
+	{
+		munmap(const_cast<char*>(data_), size_);
+	}
+	if (file_ != -1)
+	{
+		close(file_);
+	}
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	file_ = ::open(path.c_str(), O_RDONLY);
+	if (file_ == -1)
+	{
+		return false;
+	}
+
+	struct stat status{};
+	if (fstat(file_, &status) != 0 || status.st_size == 0)
+	{
+		return false;
+	}
+
+	void* data = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, file_, 0);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data_ = static_cast<const char*>(data);
+	size_ = static_cast<std::size_t>(status.st_size);
+	return true;
+}
+
+#endif
+
+std::unique_ptr<TemplatePack> TemplatePack::open(const std::string& path, u32 max_minutiae, bz3::Format format)
+{
+	auto pack = std::make_unique<TemplatePack>();
+	if (!pack->file_.open(path))
+	{
+		std::cerr << "error: cannot map template pack " << path << "\n";
+		return nullptr;
+	}
+
+	const auto bytes = pack->file_.bytes();
+	TemplatePackHeader header{};
+	if (bytes.size() < sizeof(header))
+	{
+		std::cerr << "error: file " << path << " is not a template pack\n";
+		return nullptr;
+	}
+	std::memcpy(&header, bytes.data(), sizeof(header));
+
+	if (std::memcmp(header.magic, TEMPLATE_PACK_MAGIC.data(), TEMPLATE_PACK_MAGIC.size()) != 0)
+	{
+		std::cerr << "error: file " << path << " is not a template pack\n";
+		return nullptr;
+	}
+
+	if (header.version != TEMPLATE_PACK_VERSION)
+	{
+		std::cerr << "error: template pack " << path << " has unsupported version " << header.version << "\n";
+		return nullptr;
+	}
+
+	if (header.max_minutiae != max_minutiae || header.format != static_cast<u32>(format))
+	{
+		std::cerr << "error: template pack " << path << " was prepared for " << header.max_minutiae
+			<< " minutiae in " << (header.format == static_cast<u32>(bz3::Format::Ansi) ? "ANSI" : "NIST")
+			<< " format\n";
+		return nullptr;
+	}
+
+	const auto index_size = header.number_of_templates * sizeof(TemplatePackEntry);
+	if (header.names_offset > bytes.size() || header.names_size > bytes.size() - header.names_offset ||
+		header.index_offset % alignof(TemplatePackEntry) != 0 || header.index_offset > bytes.size() ||
+		header.number_of_templates > (bytes.size() - header.index_offset) / sizeof(TemplatePackEntry) ||
+		header.index_offset + index_size != bytes.size())
+	{
+		std::cerr << "error: template pack " << path << " is corrupted\n";
+		return nullptr;
+	}
+
+	pack->names_ = std::string_view{bytes.data() + header.names_offset, header.names_size};
+	pack->index_ = std::span{
+		reinterpret_cast<const TemplatePackEntry*>(bytes.data() + header.index_offset),
+		header.number_of_templates
+	};
+	return pack;
+}
+
+std::string_view TemplatePack::name_of(const TemplatePackEntry& entry) const
+{
+	if (entry.name_offset > names_.size() || entry.name_length > names_.size() - entry.name_offset)
+	{
+		return {};
+	}
+	return names_.substr(entry.name_offset, entry.name_length);
+}
+
+// same checks as for template files, so that the matcher never indexes past the minutiae
+static bool is_valid(std::span<const Minutia> minutiae, EdgesView edges)
+{
+	for (std::size_t i = 0; i < edges.size(); i++)
+	{
+		if (edges.endpoint_k()[i] >= minutiae.size() || edges.endpoint_j()[i] >= minutiae.size() ||
+			(edges.beta_order()[i] != KJ && edges.beta_order()[i] != JK))
+		{
+			return false;
+		}
+	}
+	return std::all_of(minutiae.begin(), minutiae.end(), [](const Minutia& minutia)
+	{
+		return minutia.kind == MinutiaKind::Unknown || minutia.kind == MinutiaKind::Bif ||
+			minutia.kind == MinutiaKind::Rig;
+	});
+}
+
+/*
+ * The template is validated whenever it is found, which the template cache does once for every name;
+ * opening a pack reads only its header and index.
+ */
+std::optional<std::pair<std::span<const Minutia>, EdgesView>> TemplatePack::find(std::string_view name) const
+{
+	const auto it = std::lower_bound(index_.begin(), index_.end(), name,
+	                                 [this](const TemplatePackEntry& entry, std::string_view value)
+	                                 {
+		                                 return name_of(entry) < value;
+	                                 });
+	if (it == index_.end() || name_of(*it) != name)
+	{
+		return std::nullopt;
+	}
+
+	const auto bytes = file_.bytes();
+	const auto& entry = *it;
+	const auto size = u64{entry.number_of_minutiae} * sizeof(Minutia) + edges_size(entry.number_of_edges);
+	if (entry.number_of_minutiae > MAX_BOZORTH_MINUTIAE || entry.number_of_edges > MAX_NUMBER_OF_EDGES ||
+		entry.data_offset % TEMPLATE_PACK_ALIGNMENT != 0 || entry.data_offset > bytes.size() ||
+		size > bytes.size() - entry.data_offset)
+	{
+		std::cerr << "error: template " << name << " in template pack is corrupted\n";
+		return std::nullopt;
+	}
+
+	const auto* minutiae = reinterpret_cast<const Minutia*>(bytes.data() + entry.data_offset);
+	const auto* arrays = reinterpret_cast<const char*>(minutiae + entry.number_of_minutiae);
+	const std::size_t number_of_edges = entry.number_of_edges;
+	const auto* distance_squared = next_array<u16>(arrays, number_of_edges);
+	const auto* min_beta = next_array<i16>(arrays, number_of_edges);
+	const auto* max_beta = next_array<i16>(arrays, number_of_edges);
+	const auto* theta_kj = next_array<i16>(arrays, number_of_edges);
+	const auto* endpoint_k = next_array<u8>(arrays, number_of_edges);
+	const auto* endpoint_j = next_array<u8>(arrays, number_of_edges);
+	const auto* beta_order = next_array<OrderKJ>(arrays, number_of_edges);
+
+	// the vectorized kernel stops at the padding, so it has to be there
+	if (std::any_of(distance_squared + number_of_edges, distance_squared + number_of_edges + EdgesView::EDGE_LANES,
+	                [](u16 distance) { return distance != EdgesView::PADDING_DISTANCE; }))
+	{
+		std::cerr << "error: template " << name << " in template pack is corrupted\n";
+		return std::nullopt;
+	}
+
+	auto value = std::make_pair(
+		std::span{minutiae, entry.number_of_minutiae},
+		EdgesView{
+			number_of_edges, distance_squared, min_beta, max_beta, theta_kj, endpoint_k, endpoint_j, beta_order
+		}
+	);
+	if (!is_valid(value.first, value.second))
+	{
+		std::cerr << "error: template " << name << " in template pack is corrupted\n";
+		return std::nullopt;
+	}
+	return value;
+}
+
+bool TemplatePackWriter::open(const std::string& path, u32 max_minutiae, bz3::Format format)
+{
+	file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file_.is_open())
+	{
+		std::cerr << "error: cannot open file " << path << " for writing\n";
+		return false;
+	}
+
+	path_ = path;
+	std::memcpy(header_.magic, TEMPLATE_PACK_MAGIC.data(), TEMPLATE_PACK_MAGIC.size());
+	header_.version = TEMPLATE_PACK_VERSION;
+	header_.max_minutiae = max_minutiae;
+	header_.format = static_cast<u32>(format);
+
+	// the header is written again with the final offsets by finish()
+	const TemplatePackHeader placeholder{};
+	file_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+	offset_ = sizeof(placeholder);
+	return file_.good();
+}
+
+void TemplatePackWriter::pad_to_alignment()
+{
+	static constexpr std::array<char, TEMPLATE_PACK_ALIGNMENT> zeros{};
+	const auto padding = (TEMPLATE_PACK_ALIGNMENT - offset_ % TEMPLATE_PACK_ALIGNMENT) % TEMPLATE_PACK_ALIGNMENT;
+	file_.write(zeros.data(), static_cast<std::streamsize>(padding));
+	offset_ += padding;
+}
+
+bool TemplatePackWriter::add(std::string_view name, std::span<const Minutia> minutiae, std::span<const Edge> edges)
+{
+	pad_to_alignment();
+	index_.push_back(TemplatePackEntry{
+		.name_offset = names_.size(),
+		.name_length = static_cast<u32>(name.size()),
+		.number_of_minutiae = static_cast<u32>(minutiae.size()),
+		.data_offset = offset_,
+		.number_of_edges = static_cast<u32>(edges.size()),
+		.reserved = 0,
+	});
+	names_.append(name);
+
+	write_template_records(file_, minutiae, {});
+	const Edges arrays{edges};
+	const auto view = arrays.view();
+	write_array(file_, view.distance_squared(), view.size());
+	write_array(file_, view.min_beta(), view.size());
+	write_array(file_, view.max_beta(), view.size());
+	write_array(file_, view.theta_kj(), view.size());
+	write_array(file_, view.endpoint_k(), view.size());
+	write_array(file_, view.endpoint_j(), view.size());
+	write_array(file_, view.beta_order(), view.size());
+	offset_ += minutiae.size() * sizeof(Minutia) + edges_size(edges.size());
+	return file_.good();
+}
+
+bool TemplatePackWriter::finish()
+{
+	const auto name_of = [this](const TemplatePackEntry& entry)
+	{
+		return std::string_view{names_}.substr(entry.name_offset, entry.name_length);
+	};
+
+	std::sort(index_.begin(), index_.end(), [&](const TemplatePackEntry& a, const TemplatePackEntry& b)
+	{
+		return name_of(a) < name_of(b);
+	});
+	const auto duplicate = std::adjacent_find(index_.begin(), index_.end(),
+	                                          [&](const TemplatePackEntry& a, const TemplatePackEntry& b)
+	                                          {
+		                                          return name_of(a) == name_of(b);
+	                                          });
+	if (duplicate != index_.end())
+	{
+		std::cerr << "error: template " << name_of(*duplicate) << " is added to template pack " << path_
+			<< " more than once\n";
+		return false;
+	}
+
+	pad_to_alignment();
+	header_.names_offset = offset_;
+	header_.names_size = names_.size();
+	file_.write(names_.data(), static_cast<std::streamsize>(names_.size()));
+	offset_ += names_.size();
+
+	pad_to_alignment();
+	header_.index_offset = offset_;
+	header_.number_of_templates = index_.size();
+	file_.write(reinterpret_cast<const char*>(index_.data()),
+	            static_cast<std::streamsize>(index_.size() * sizeof(TemplatePackEntry)));
+
+	file_.seekp(0);
+	file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+	file_.close();
+	if (file_.fail())
+	{
+		std::cerr << "error: cannot write template pack " << path_ << "\n";
+		return false;
+	}
+	return true;
+}
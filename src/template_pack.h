@@ -0,0 +1,130 @@
+#ifndef BZ_TEMPLATE_PACK_H
+#define BZ_TEMPLATE_PACK_H
+
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "bozorth3/bozorth3.h"
+
+/*
+ * Pack file (.bzp) with many templates prepared for the same max_minutiae and format:
+ *
+ *   TemplatePackHeader
+ *   data blocks: for every template its minutiae in the in-memory layout of Minutia, followed by the
+ *                arrays of its edges as in EdgesView (distance_squared, min_beta, max_beta, theta_kj,
+ *                endpoint_k, endpoint_j, beta_order), each with its EDGE_LANES padding entries;
+ *                every block is aligned to TEMPLATE_PACK_ALIGNMENT
+ *   names:       names of all templates, one after another without separators
+ *   index:       TemplatePackEntry for every template, sorted by name
+ *
+ * A pack is memory mapped and its templates are returned as views into the mapping, already in the
+ * layout of the matcher, so opening it does not read the templates and processes matching against
+ * the same pack share its pages.
+ */
+constexpr std::string_view TEMPLATE_PACK_EXTENSION = ".bzp";
+constexpr u32 TEMPLATE_PACK_VERSION = 2;
+constexpr u64 TEMPLATE_PACK_ALIGNMENT = 64;
+
+struct TemplatePackHeader
+{
+	char magic[4];
+	u32 version;
+	u32 max_minutiae;
+	u32 format;
+	u64 number_of_templates;
+	u64 names_offset;
+	u64 names_size;
+	u64 index_offset;
+	u64 reserved[2];
+};
+
+static_assert(sizeof(TemplatePackHeader) == TEMPLATE_PACK_ALIGNMENT);
+
+struct TemplatePackEntry
+{
+	u64 name_offset;
+	u32 name_length;
+	u32 number_of_minutiae;
+	u64 data_offset;
+	u32 number_of_edges;
+	u32 reserved;
+};
+
+static_assert(sizeof(TemplatePackEntry) == 32);
+
+bool is_template_pack(std::string_view path);
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const char* data_ = nullptr;
+	std::size_t size_ = 0;
+#ifdef _WIN32
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+
+public:
+	MappedFile() = default;
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	bool open(const std::string& path);
+
+	[[nodiscard]] std::span<const char> bytes() const { return {data_, size_}; }
+};
+
+class TemplatePack
+{
+private:
+	MappedFile file_{};
+	std::span<const TemplatePackEntry> index_{};
+	std::string_view names_{};
+
+	[[nodiscard]] std::string_view name_of(const TemplatePackEntry& entry) const;
+
+public:
+	static std::unique_ptr<TemplatePack> open(const std::string& path, u32 max_minutiae, bz3::Format format);
+
+	[[nodiscard]] std::size_t size() const { return index_.size(); }
+
+	// name of the template at the position in the index, a view into the mapping
+	[[nodiscard]] std::string_view name(std::size_t index) const { return name_of(index_[index]); }
+
+	[[nodiscard]] std::optional<std::pair<std::span<const Minutia>, EdgesView>> find(std::string_view name) const;
+};
+
+// writes a pack file template by template; the index is written by finish()
+class TemplatePackWriter
+{
+private:
+	std::ofstream file_{};
+	std::string path_{};
+	TemplatePackHeader header_{};
+	std::vector<TemplatePackEntry> index_{};
+	std::string names_{};
+	u64 offset_ = 0;
+
+	void pad_to_alignment();
+
+public:
+	bool open(const std::string& path, u32 max_minutiae, bz3::Format format);
+
+	bool add(std::string_view name, std::span<const Minutia> minutiae, std::span<const Edge> edges);
+
+	bool finish();
+};
+
+#endif //BZ_TEMPLATE_PACK_H
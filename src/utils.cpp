@@ -3,107 +3,147 @@
 //
 
 #include "utils.h"
+#include "minutiae_record.h"
+#include "template_file.h"
+#include "template_pack.h"
 #include <algorithm>
 #include <array>
+#include <cassert>
+#include <charconv>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <atomic>
+#include <filesystem>
+#include <random>
+#include <thread>
 
 constexpr std::size_t MAX_FILE_MINUTIAE = 1000;
 
 
 using namespace bz3;
 
-std::optional<std::vector<Minutia>> load_minutiae(
-	std::string_view xyt_path,
-	std::optional<std::string_view> min_path,
-	u32 max_minutiae
-)
+// reads the whole file into the buffer, which keeps its capacity between files
+static bool read_file(std::string_view path, std::vector<char>& buffer)
 {
-	std::ifstream xyt_file{xyt_path.data(), std::ios::in};
-	if (xyt_file.fail())
+	std::ifstream file{std::string{path}, std::ios::in | std::ios::binary | std::ios::ate};
+	if (file.fail())
 	{
-		return {};
+		return false;
 	}
 
-	std::vector<RawMinutia> minutiae{};
-	minutiae.reserve(MAX_BOZORTH_MINUTIAE);
-	while (!xyt_file.eof())
+	const auto size = static_cast<std::size_t>(file.tellg());
+	buffer.resize(size);
+	file.seekg(0);
+	file.read(buffer.data(), static_cast<std::streamsize>(size));
+	return !file.fail();
+}
+
+// removes the first line (without its end) from the text; accepts both LF and CRLF line ends
+static std::string_view next_line(std::string_view& text)
+{
+	const auto end = text.find('\n');
+	auto line = text.substr(0, end);
+	text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+	if (!line.empty() && line.back() == '\r')
 	{
-		RawMinutia min{};
-		xyt_file >> min.x;
-		if (xyt_file.eof()) break;
-		xyt_file >> min.y;
-		if (xyt_file.eof()) break;
-		xyt_file >> min.t;
-		if (xyt_file.eof()) break;
-		xyt_file >> min.q;
-		if (xyt_file.eof()) break;
-		minutiae.push_back(min);
-		if (minutiae.size() == MAX_FILE_MINUTIAE)
-		{
-			break;
-		}
+		line.remove_suffix(1);
 	}
+	return line;
+}
 
-	if (min_path)
+static const char* skip_blanks(const char* first, const char* last)
+{
+	while (first != last && (*first == ' ' || *first == '\t'))
 	{
-		std::ifstream min_file{min_path.value().data(), std::ios::in};
-		if (min_file.is_open())
+		first++;
+	}
+	return first;
+}
+
+std::optional<std::vector<RawMinutia>> parse_xyt(std::string_view text, std::string_view source)
+{
+	std::vector<RawMinutia> minutiae{};
+	minutiae.reserve(MAX_BOZORTH_MINUTIAE);
+	for (u32 line_number = 1; !text.empty() && minutiae.size() < MAX_FILE_MINUTIAE; line_number++)
+	{
+		const auto line = next_line(text);
+		const char* position = line.data();
+		const char* const last = line.data() + line.size();
+
+		std::array<int, 4> values{};
+		std::size_t count = 0;
+		for (; count < values.size(); count++)
 		{
-			auto min_index = 0u;
-			for (auto i = 0u; !min_file.eof(); i++)
+			const auto [end, error] = std::from_chars(skip_blanks(position, last), last, values[count]);
+			if (error != std::errc{})
 			{
-				std::string line{};
-				std::getline(min_file, line);
-
-				if (i < 4)
-				{
-					continue;
-				}
-				const auto kind = line.substr(33, 3);
-				auto& minutia = minutiae.at(min_index);
-				if (kind == "BIF")
-				{
-					minutia.kind = MinutiaKind::Bif;
-				}
-				else if (kind == "RIG")
-				{
-					minutia.kind = MinutiaKind::Rig;
-				}
-				else
-				{
-					minutia.kind = std::nullopt;
-				}
+				break;
 			}
+			position = end;
 		}
-	}
+		position = skip_blanks(position, last);
 
-	return prune_minutiae(minutiae, max_minutiae);
+		if (count == 0 && position == last)
+		{
+			continue;
+		}
+		if (count != values.size() || position != last)
+		{
+			std::cerr << "error: " << source << ":" << line_number << ": malformed minutia '" << line << "'\n";
+			return std::nullopt;
+		}
+		// minutiae keep their coordinates and angle in 16 bits
+		const auto fits = [](int value)
+		{
+			return value >= INT16_MIN && value <= INT16_MAX;
+		};
+		if (!fits(values[0]) || !fits(values[1]) || !fits(values[2]))
+		{
+			std::cerr << "error: " << source << ":" << line_number << ": minutia out of range '" << line << "'\n";
+			return std::nullopt;
+		}
+		minutiae.push_back(RawMinutia{.x = values[0], .y = values[1], .t = values[2], .q = values[3]});
+	}
+	return minutiae;
 }
 
+static std::optional<std::vector<RawMinutia>> load_xyt(std::string_view xyt_path)
+{
+	thread_local std::vector<char> buffer{};
+
+	if (!read_file(xyt_path, buffer))
+	{
+		return std::nullopt;
+	}
+	return parse_xyt(std::string_view{buffer.data(), buffer.size()}, xyt_path);
+}
 
-struct Cell
+std::optional<std::vector<Minutia>> load_minutiae(std::string_view xyt_path, u32 max_minutiae)
 {
-	int value; /* pointer to an array of pointers to index arrays */
-	int index; /* pointer to an item array */
-};
+	auto minutiae = load_xyt(xyt_path);
+	if (!minutiae.has_value())
+	{
+		return {};
+	}
+	return prune_minutiae(minutiae.value(), max_minutiae);
+}
 
 /***********************************************************************/
 /*******************************************************************
 select_pivot()
 selects a pivot from a list being sorted using the Singleton Method.
 *******************************************************************/
-static int select_pivot(Cell v[], int left, int right)
+static int select_pivot(const RawMinutia v[], int left, int right)
 {
 	int midpoint = (left + right) / 2;
 
-	int ileft = v[left].value;
-	int imidpoint = v[midpoint].value;
-	int iright = v[right].value;
+	int ileft = v[left].q;
+	int imidpoint = v[midpoint].q;
+	int iright = v[right].q;
 	if (ileft <= imidpoint)
 	{
 		if (imidpoint <= iright)
@@ -134,7 +174,7 @@ Inputs a pivot element making comparisons and swaps with other elements in a lis
 until pivot resides at its correct position in the list.
 ********************************************************/
 static void
-partition_dec(Cell v[], int* llen, int* rlen, int* ll, int* lr, int* rl, int* rr, int p, int l, int r)
+partition_dec(RawMinutia v[], int* llen, int* rlen, int* ll, int* lr, int* rl, int* rr, int p, int l, int r)
 {
 	*ll = l;
 	*rr = r;
@@ -142,7 +182,7 @@ partition_dec(Cell v[], int* llen, int* rlen, int* ll, int* lr, int* rl, int* rr
 	{
 		if (l < p)
 		{
-			if (v[l].value < v[p].value)
+			if (v[l].q < v[p].q)
 			{
 				std::swap(v[l], v[p]);
 				p = l;
@@ -156,7 +196,7 @@ partition_dec(Cell v[], int* llen, int* rlen, int* ll, int* lr, int* rl, int* rr
 		{
 			if (r > p)
 			{
-				if (v[r].value > v[p].value)
+				if (v[r].q > v[p].q)
 				{
 					std::swap(v[r], v[p]);
 					p = r;
@@ -182,67 +222,49 @@ partition_dec(Cell v[], int* llen, int* rlen, int* ll, int* lr, int* rl, int* rr
 /***********************************************************************/
 /********************************************************
 qsort_decreasing()
-This procedure inputs a pointer to an index_struct, the subscript of an index array to be
-sorted, a left subscript pointing to where the  sort is to begin in the index array, and a right
-subscript where to end. This module invokes a  decreasing quick-sort sorting the index array  from l to r.
+Sorts the minutiae by decreasing quality in place with the quick-sort of NIST, which is not
+stable. Segments starting at or after limit are left unsorted: the partitions never move
+minutiae between segments, so the first limit minutiae end up exactly as after a full sort,
+including the order of minutiae of the same quality.
 ********************************************************/
-
-
-static void qsort_decreasing(Cell v[], int left, int right)
+static void qsort_decreasing(std::span<RawMinutia> v, int limit)
 {
-	std::vector<int> stack{};
-	stack.push_back(left);
-	stack.push_back(right);
-	while (!stack.empty())
+	struct Segment
+	{
+		int left;
+		int right;
+	};
+
+	// the smaller segment is sorted first, so at most log2(size) + 1 segments wait on the stack
+	std::array<Segment, 40> stack{};
+	std::size_t size = 0;
+	const auto push = [&](int left, int right)
 	{
-		right = stack.back();
-		stack.pop_back();
-		left = stack.back();
-		stack.pop_back();
-		if (left < right)
+		if (left < right && left < limit)
 		{
-			int pivot = select_pivot(v, left, right);
-			int llen, rlen;
-			int lleft, lright, rleft, rright;
-			partition_dec(v, &llen, &rlen, &lleft, &lright, &rleft, &rright, pivot, left, right);
-			if (llen > rlen)
-			{
-				stack.push_back(lleft);
-				stack.push_back(lright);
-				stack.push_back(rleft);
-				stack.push_back(rright);
-			}
-			else
-			{
-				stack.push_back(rleft);
-				stack.push_back(rright);
-				stack.push_back(lleft);
-				stack.push_back(lright);
-			}
+			assert(size < stack.size());
+			stack[size++] = Segment{left, right};
 		}
-	}
-}
-
-static
-void sort_order_decreasing(
-	const int values[], /* INPUT:  the unsorted values themselves */
-	int num, /* INPUT:  the number of values */
-	int order[] /* OUTPUT: the order for each of the values if sorted */
-)
-{
-	std::vector<Cell> cells; // index, item
-	cells.reserve(static_cast<unsigned long>(num));
+	};
 
-	for (int i = 0; i < num; i++)
+	push(0, static_cast<int>(v.size()) - 1);
+	while (size > 0)
 	{
-		cells.push_back({values[i], i});
-	}
-
-	qsort_decreasing(cells.data(), 0, num - 1);
-
-	for (int i = 0; i < num; i++)
-	{
-		order[i] = cells[i].index;
+		const auto [left, right] = stack[--size];
+		int pivot = select_pivot(v.data(), left, right);
+		int llen, rlen;
+		int lleft, lright, rleft, rright;
+		partition_dec(v.data(), &llen, &rlen, &lleft, &lright, &rleft, &rright, pivot, left, right);
+		if (llen > rlen)
+		{
+			push(lleft, lright);
+			push(rleft, rright);
+		}
+		else
+		{
+			push(rleft, rright);
+			push(lleft, lright);
+		}
 	}
 }
 
@@ -253,49 +275,31 @@ Row 3's value is an angle which is normalized to the interval (-180,180].
 A maximum of MAX_BOZORTH_MINUTIAE minutiae can be returned -- fewer if
 "max_minutiae" is smaller.  If the file contains more minutiae than are
 to be returned, the highest-quality minutiae are returned.
+The minutiae are reordered in place while selecting them. Their coordinates
+and angles have to fit in 16 bits, which parse_xyt checks for .xyt files.
 *************************************************************************/
 std::vector<Minutia> prune_minutiae(std::span<RawMinutia> minutiae, u32 max_minutiae)
 {
-	std::array<RawMinutia, MAX_FILE_MINUTIAE> m{};
-
-	u32 length = static_cast<u32>(minutiae.size());
-	for (u32 i = 0u; i < length; i++)
+	const auto length = std::min<std::size_t>(minutiae.size(), max_minutiae);
+	if (minutiae.size() > max_minutiae)
 	{
-		m[i].x = minutiae[i].x;
-		m[i].y = minutiae[i].y;
-		m[i].t = minutiae[i].t > 180
-			         ? minutiae[i].t - 360
-			         : minutiae[i].t;
-		m[i].q = minutiae[i].q;
+		qsort_decreasing(minutiae, static_cast<int>(max_minutiae));
 	}
 
-	std::array<RawMinutia, MAX_FILE_MINUTIAE> c{};
-	if (length > max_minutiae)
-	{
-		std::array<int, MAX_FILE_MINUTIAE> q{};
-		for (u32 j = 0u; j < length; j++)
-		{
-			q[j] = minutiae[j].q;
-		}
-
-		std::array<int, MAX_FILE_MINUTIAE> order{};
-		sort_order_decreasing(q.data(), static_cast<int>(length), order.data());
-
-		for (u32 j = 0u; j < max_minutiae; j++)
-		{
-			c[j] = m[static_cast<unsigned int>(order[j])];
-		}
-		length = max_minutiae;
-	}
-	else
+	std::vector<Minutia> xyt_s{};
+	xyt_s.reserve(length);
+	for (const auto& minutia : minutiae.first(length))
 	{
-		for (u32 j = 0u; j < length; j++)
-		{
-			c[j] = m[j];
-		}
+		assert(minutia.x >= INT16_MIN && minutia.x <= INT16_MAX && minutia.y >= INT16_MIN && minutia.y <= INT16_MAX);
+		xyt_s.emplace_back(Minutia{
+			.x = static_cast<i16>(minutia.x),
+			.y = static_cast<i16>(minutia.y),
+			.t = static_cast<i16>(minutia.t > 180 ? minutia.t - 360 : minutia.t),
+			.kind = minutia.kind,
+		});
 	}
 
-	std::sort(c.begin(), c.begin() + static_cast<ptrdiff_t>(length), [](const auto& l, const auto& r)
+	std::sort(xyt_s.begin(), xyt_s.end(), [](const auto& l, const auto& r)
 	{
 		if (l.x < r.x)
 		{
@@ -307,17 +311,9 @@ std::vector<Minutia> prune_minutiae(std::span<RawMinutia> minutiae, u32 max_minu
 		}
 		return l.y < r.y;
 	});
-
-	std::vector<Minutia> xyt_s{};
-	xyt_s.reserve(length);
-	for (u32 j = 0u; j < length; j++)
-	{
-		xyt_s.emplace_back(Minutia{c[j].x, c[j].y, c[j].t, c[j].kind});
-	}
 	return xyt_s;
 }
 
-
 static void limit_edges(std::vector<Edge>& edges)
 {
 	const int calculated_limit = static_cast<const int>(limit_edges_by_length(edges));
@@ -327,66 +323,269 @@ static void limit_edges(std::vector<Edge>& edges)
 	edges.erase(edges.begin() + actual_limit, edges.end());
 }
 
-std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
-prepare_data(const std::string& file_name, u32 max_minutiae, Format mode)
+static std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
+prepare_source(const std::string& file_name, u32 max_minutiae, Format mode)
 {
-	auto minutiae = load_minutiae(file_name, std::nullopt, max_minutiae);
+	auto minutiae = is_minutiae_record(file_name)
+		                ? load_record_minutiae(file_name, mode)
+		                : load_xyt(file_name);
 	if (!minutiae.has_value())
 	{
 		std::cerr << "error: cannot load minutiae from file " << file_name << "\n";
 		return std::nullopt;
 	}
 
+	return prepare_minutiae(minutiae.value(), max_minutiae, mode);
+}
+
+std::pair<std::vector<Minutia>, std::vector<Edge>>
+prepare_minutiae(std::span<RawMinutia> minutiae, u32 max_minutiae, Format mode)
+{
+	auto pruned = prune_minutiae(minutiae, max_minutiae);
+
 	std::vector<Edge> edges{};
-	find_edges(minutiae.value(), edges, mode);
+	find_edges(pruned, edges, mode);
 	limit_edges(edges);
 
-	return std::make_pair(std::move(minutiae.value()), std::move(edges));
+	return std::make_pair(std::move(pruned), std::move(edges));
 }
 
-std::optional<std::pair<std::span<const Minutia>, std::span<const Edge>>>
-cache_data(
-	std::map<std::string, std::pair<std::vector<Minutia>, std::vector<Edge>>>& items,
-	const std::string& file_name,
-	u32 max_minutiae
-)
+static std::optional<std::filesystem::path> template_cache_directory{};
+
+void use_template_cache_directory(const std::string& directory)
 {
-	if (auto it = items.find(file_name); it != items.end()
-	)
+	template_cache_directory = std::filesystem::path{directory};
+}
+
+// FNV-1a
+static u64 hash_bytes(std::span<const char> bytes)
+{
+	u64 hash = 0xcbf29ce484222325;
+	for (const auto byte : bytes)
 	{
-		const auto& [minutiae, edges] = it->second;
-		return std::make_pair(std::span(minutiae), std::span(edges));
+		hash = (hash ^ static_cast<u8>(byte)) * 0x100000001b3;
 	}
+	return hash;
+}
+
+// has to be increased whenever pruning or finding and limiting edges changes, so that templates
+// prepared by older builds are not reused from the cache directory
+constexpr u32 TEMPLATE_PREPARATION_VERSION = 1;
+
+/*
+ * Name of the prepared template in the cache directory: hash and size of the content of the source
+ * file, then everything else the template depends on. The path of the source is not part of it, so
+ * copies of the same file share one entry.
+ */
+static std::optional<std::string> template_cache_key(const std::string& file_name, u32 max_minutiae, Format mode)
+{
+	thread_local std::vector<char> buffer{};
 
-	if (auto value = prepare_data(file_name, max_minutiae); value.has_value()
-	)
+	const auto [path, view] = split_finger_view(file_name);
+	if (!read_file(is_minutiae_record(file_name) ? path : file_name, buffer))
 	{
-		const auto& [minutiae, edges] = items[file_name] = value.value();
-		return std::make_pair(std::span(minutiae), std::span(edges));
+		return std::nullopt;
 	}
-	else
+
+	std::array<char, 16> hash{};
+	const auto [end, error] = std::to_chars(hash.data(), hash.data() + hash.size(), hash_bytes(buffer), 16);
+	std::string key{hash.data(), end};
+	key.insert(0, hash.size() - key.size(), '0');
+
+	key += "-" + std::to_string(buffer.size()) + "-v" + std::to_string(TEMPLATE_FILE_VERSION) + "-p" +
+		std::to_string(TEMPLATE_PREPARATION_VERSION) + "-n" + std::to_string(max_minutiae) +
+		(mode == Format::Ansi ? "-ansi" : "-nist");
+	if (is_minutiae_record(file_name))
 	{
-		return std::nullopt;
+		key += "-view" + std::to_string(view.value_or(0));
 	}
+	return key + std::string{TEMPLATE_FILE_EXTENSION};
 }
 
-thread_local PairHolder pair_holder{};
-thread_local BozorthState state{};
+/*
+ * Writes the template under a name unique to this thread and renames it into place, so that other
+ * processes sharing the directory never see a partial file. When several processes prepare the same
+ * template, each rename replaces the file of the previous one; the files are identical, so the last
+ * one stays. The temporary file is removed only when writing or renaming it fails.
+ */
+static void store_in_template_cache(const std::filesystem::path& target, std::span<const Minutia> minutiae,
+                                    std::span<const Edge> edges, u32 max_minutiae, Format mode)
+{
+	thread_local const auto unique_suffix = std::to_string(std::random_device{}()) + "-" +
+		std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
 
-constexpr std::size_t MIN_COMPUTABLE_BOZORTH_MINUTIAE = 10;
+	auto temporary = target;
+	temporary += ".tmp-" + unique_suffix;
+	std::error_code error{};
+	if (save_template(temporary.string(), minutiae, edges, max_minutiae, mode))
+	{
+		std::filesystem::rename(temporary, target, error);
+		if (!error)
+		{
+			return;
+		}
+	}
+	std::filesystem::remove(temporary, error);
+}
 
-u32 match(std::span<const Minutia> probe_minutiae, std::span<const Edge> probe_edges,
-          std::span<const Minutia> gallery_minutiae, std::span<const Edge> gallery_edges, Format format)
+std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
+prepare_data(const std::string& file_name, u32 max_minutiae, Format mode)
 {
-	if (probe_minutiae.size() < MIN_COMPUTABLE_BOZORTH_MINUTIAE ||
-		gallery_minutiae.size() < MIN_COMPUTABLE_BOZORTH_MINUTIAE)
+	if (is_template_file(file_name))
+	{
+		return load_template(file_name, max_minutiae, mode);
+	}
+
+	if (!template_cache_directory.has_value())
+	{
+		return prepare_source(file_name, max_minutiae, mode);
+	}
+
+	const auto key = template_cache_key(file_name, max_minutiae, mode);
+	if (!key.has_value())
+	{
+		return prepare_source(file_name, max_minutiae, mode);
+	}
+
+	const auto cached = template_cache_directory.value() / key.value();
+	if (std::error_code error{}; std::filesystem::exists(cached, error))
+	{
+		if (auto value = load_template(cached.string(), max_minutiae, mode); value.has_value()
+		)
+		{
+			return value;
+		}
+	}
+
+	auto value = prepare_source(file_name, max_minutiae, mode);
+	if (value.has_value())
+	{
+		store_in_template_cache(cached, value->first, value->second, max_minutiae, mode);
+	}
+	return value;
+}
+
+static std::vector<std::shared_ptr<const TemplatePack>> template_packs{};
+
+void use_template_pack(std::shared_ptr<const TemplatePack> pack)
+{
+	template_packs.push_back(std::move(pack));
+}
+
+std::optional<std::pair<std::span<const Minutia>, EdgesView>>
+find_packed_data(const std::string& file_name)
+{
+	for (const auto& pack : template_packs)
 	{
-		return 0;
+		if (auto value = pack->find(file_name); value.has_value()
+		)
+		{
+			return value;
+		}
 	}
+	return std::nullopt;
+}
+
+// scratch state of the matcher for templates of at most Capacity minutiae
+template <std::size_t Capacity>
+struct Matcher
+{
+	PairHolder<Capacity> pair_holder{};
+	BozorthState<Capacity> state{};
+};
+
+// every thread creates only the matchers of the capacities it actually uses
+template <std::size_t Capacity>
+static Matcher<Capacity>& thread_matcher()
+{
+	thread_local Matcher<Capacity> matcher{};
+	return matcher;
+}
+
+static std::atomic<u64> early_rejects{0};
+
+constexpr std::size_t MIN_COMPUTABLE_BOZORTH_MINUTIAE = 10;
+
+// EdgeList is std::span<const Edge> for the scalar kernel or EdgesView for the vectorized one
+template <std::size_t Capacity, typename EdgeList>
+static MatchResult match(std::span<const Minutia> probe_minutiae, EdgeList probe_edges,
+                         std::span<const Minutia> gallery_minutiae, EdgeList gallery_edges,
+                         Format format, std::optional<u32> threshold)
+{
+	auto& [pair_holder, state] = thread_matcher<Capacity>();
+
 	pair_holder.clear();
-	match_edges_into_pairs(probe_edges, probe_minutiae, gallery_edges, gallery_minutiae,
-	                       pair_holder);
+	match_edges_into_pairs(probe_edges, probe_minutiae, gallery_edges, gallery_minutiae, pair_holder);
+
+	if (threshold.has_value())
+	{
+		if (const auto bound = score_upper_bound(pair_holder); bound < threshold.value())
+		{
+			early_rejects.fetch_add(1, std::memory_order_relaxed);
+			return MatchResult{.score = bound, .kind = ScoreKind::UpperBound};
+		}
+	}
+
 	pair_holder.prepare();
 	state.clear();
-	return match_score(pair_holder, state, probe_minutiae, gallery_minutiae, format);
+	return match_score(pair_holder, state, probe_minutiae, gallery_minutiae, format, threshold);
+}
+
+template <typename EdgeList>
+static MatchResult match_with_capacity(std::span<const Minutia> probe_minutiae, EdgeList probe_edges,
+                                       std::span<const Minutia> gallery_minutiae, EdgeList gallery_edges,
+                                       Format format, std::optional<u32> threshold)
+{
+	if (probe_minutiae.size() < MIN_COMPUTABLE_BOZORTH_MINUTIAE ||
+		gallery_minutiae.size() < MIN_COMPUTABLE_BOZORTH_MINUTIAE)
+	{
+		return MatchResult{};
+	}
+
+	// the smallest matcher which can index the endpoints of both templates
+	const auto minutiae = std::max(probe_minutiae.size(), gallery_minutiae.size());
+	if (minutiae <= SMALL_MINUTIAE_CAPACITY)
+	{
+		return match<SMALL_MINUTIAE_CAPACITY>(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges,
+		                                      format, threshold);
+	}
+	if (minutiae <= MEDIUM_MINUTIAE_CAPACITY)
+	{
+		return match<MEDIUM_MINUTIAE_CAPACITY>(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges,
+		                                       format, threshold);
+	}
+	assert(minutiae <= MAX_BOZORTH_MINUTIAE);
+	return match<MAX_BOZORTH_MINUTIAE>(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges,
+	                                   format, threshold);
+}
+
+u32 match(std::span<const Minutia> probe_minutiae, std::span<const Edge> probe_edges,
+          std::span<const Minutia> gallery_minutiae, std::span<const Edge> gallery_edges, Format format)
+{
+	return match(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges, format, std::nullopt).score;
+}
+
+MatchResult match(std::span<const Minutia> probe_minutiae, std::span<const Edge> probe_edges,
+                  std::span<const Minutia> gallery_minutiae, std::span<const Edge> gallery_edges,
+                  Format format, std::optional<u32> threshold)
+{
+	return match_with_capacity(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges, format, threshold);
+}
+
+u32 match(std::span<const Minutia> probe_minutiae, EdgesView probe_edges,
+          std::span<const Minutia> gallery_minutiae, EdgesView gallery_edges, Format format)
+{
+	return match(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges, format, std::nullopt).score;
+}
+
+MatchResult match(std::span<const Minutia> probe_minutiae, EdgesView probe_edges,
+                  std::span<const Minutia> gallery_minutiae, EdgesView gallery_edges,
+                  Format format, std::optional<u32> threshold)
+{
+	return match_with_capacity(probe_minutiae, probe_edges, gallery_minutiae, gallery_edges, format, threshold);
+}
+
+u64 count_early_rejects()
+{
+	return early_rejects.load(std::memory_order_relaxed);
 }
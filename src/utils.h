@@ -17,26 +17,59 @@ struct RawMinutia
 	int y{};
 	int t{};
 	int q{};
-	std::optional<MinutiaKind> kind{};
+	MinutiaKind kind = MinutiaKind::Unknown;
 };
 
-std::optional<std::vector<Minutia>> load_minutiae(
-	std::string_view xyt_path,
-	std::optional<std::string_view> min_path,
-	u32 max_minutiae
-);
+// parses minutiae of an .xyt file (x, y, theta and quality in every line); source names the text in errors
+std::optional<std::vector<RawMinutia>> parse_xyt(std::string_view text, std::string_view source);
+
+std::optional<std::vector<Minutia>> load_minutiae(std::string_view xyt_path, u32 max_minutiae);
 
 std::vector<Minutia> prune_minutiae(std::span<RawMinutia> minutiae, u32 max_minutiae);
 
+// matches edges as produced by find_edges with the scalar kernel
 u32 match(std::span<const Minutia> probe_minutiae, std::span<const Edge> probe_edges,
           std::span<const Minutia> gallery_minutiae, std::span<const Edge> gallery_edges, bz3::Format format);
 
+bz3::MatchResult match(std::span<const Minutia> probe_minutiae, std::span<const Edge> probe_edges,
+                       std::span<const Minutia> gallery_minutiae, std::span<const Edge> gallery_edges,
+                       bz3::Format format, std::optional<u32> threshold);
+
+// matches edges converted once per template into structures of arrays with the vectorized kernel
+u32 match(std::span<const Minutia> probe_minutiae, EdgesView probe_edges,
+          std::span<const Minutia> gallery_minutiae, EdgesView gallery_edges, bz3::Format format);
+
+bz3::MatchResult match(std::span<const Minutia> probe_minutiae, EdgesView probe_edges,
+                       std::span<const Minutia> gallery_minutiae, EdgesView gallery_edges,
+                       bz3::Format format, std::optional<u32> threshold);
+
+// number of comparisons in all threads rejected by bz3::score_upper_bound before clustering
+u64 count_early_rejects();
+
+/*
+ * Makes prepare_data keep prepared templates as template files in the directory and reuse them while
+ * their source files stay the same. The directory can be shared by concurrent processes.
+ */
+void use_template_cache_directory(const std::string& directory);
+
 std::optional<std::pair<std::vector<Minutia>, std::vector<Edge>>>
 prepare_data(const std::string& file_name, u32 max_minutiae, bz3::Format mode = bz3::Format::NistInternal);
 
-std::optional<std::pair<std::span<const Minutia>, std::span<const Edge>>>
-cache_data(std::map<std::string, std::pair<std::vector<Minutia>, std::vector<Edge>>>& items,
-           const std::string& file_name, u32 max_minutiae);
+// template of minutiae which are not read from a file, pruned the same way as the ones of .xyt files
+std::pair<std::vector<Minutia>, std::vector<Edge>>
+prepare_minutiae(std::span<RawMinutia> minutiae, u32 max_minutiae, bz3::Format mode = bz3::Format::NistInternal);
+
+class TemplatePack;
+
+/*
+ * Makes the templates of the pack available straight from its mapping instead of loading
+ * files with the same names. Packs have to be added before matching starts and stay open until exit.
+ */
+void use_template_pack(std::shared_ptr<const TemplatePack> pack);
+
+// template of the given name from the used packs
+std::optional<std::pair<std::span<const Minutia>, EdgesView>>
+find_packed_data(const std::string& file_name);
 
 
 #endif //BZ_UTILS_H